@@ -0,0 +1,88 @@
+# caste_detect([PREFIX <prefix>] [EXECUTABLE <path>] [POLICY <file>]
+#              [COMPILE_JOB_MEM <size>] [LINK_JOB_MEM <size>])
+#
+# Runs `caste --export dotenv` at configure time and sets, in the caller's
+# scope (default prefix CASTE):
+#
+#   <prefix>_CASTE          Mini, User, Developer, Workstation or Rig
+#   <prefix>_ISA_LEVEL      -march value: x86-64, x86-64-v2/v3/v4, armv8-a, or empty
+#   <prefix>_THREADS, <prefix>_CORES, <prefix>_RAM_BYTES, <prefix>_VRAM_BYTES
+#   <prefix>_COMPILE_JOBS   parallel compile jobs that fit CPUs and memory
+#   <prefix>_LINK_JOBS      parallel link jobs for LINK_JOB_MEM (default 4GiB)
+#   <prefix>_JOB_POOLS      "compile=<n>;link=<m>" for the JOB_POOLS property
+#   <prefix>_FOUND          TRUE if the command ran
+#
+# The executable is EXECUTABLE, else CASTE_EXECUTABLE, else the imported
+# caste::caste_cli target, else `caste` on PATH. Results describe the machine
+# configuring the build, so do not use them when cross-compiling.
+#
+#   caste_detect()
+#   set_property(GLOBAL APPEND PROPERTY JOB_POOLS ${CASTE_JOB_POOLS})
+#   set(CMAKE_JOB_POOL_COMPILE compile)
+#   set(CMAKE_JOB_POOL_LINK link)
+
+function(caste_detect)
+    cmake_parse_arguments(ARG "" "PREFIX;EXECUTABLE;POLICY;COMPILE_JOB_MEM;LINK_JOB_MEM" "" ${ARGN})
+    if (NOT ARG_PREFIX)
+        set(ARG_PREFIX CASTE)
+    endif()
+
+    set(exe "${ARG_EXECUTABLE}")
+    if (NOT exe AND CASTE_EXECUTABLE)
+        set(exe "${CASTE_EXECUTABLE}")
+    endif()
+    if (NOT exe AND TARGET caste::caste_cli)
+        get_target_property(exe caste::caste_cli LOCATION)
+    endif()
+    if (NOT exe)
+        find_program(CASTE_COMMAND caste)
+        set(exe "${CASTE_COMMAND}")
+    endif()
+
+    set(${ARG_PREFIX}_FOUND FALSE PARENT_SCOPE)
+    if (NOT exe OR NOT EXISTS "${exe}")
+        message(STATUS "caste_detect: caste executable not found")
+        return()
+    endif()
+
+    set(args --export dotenv)
+    if (ARG_POLICY)
+        list(APPEND args --policy "${ARG_POLICY}")
+    endif()
+    if (ARG_COMPILE_JOB_MEM)
+        list(APPEND args --compile-job-mem "${ARG_COMPILE_JOB_MEM}")
+    endif()
+    if (ARG_LINK_JOB_MEM)
+        list(APPEND args --link-job-mem "${ARG_LINK_JOB_MEM}")
+    endif()
+    execute_process(COMMAND "${exe}" ${args}
+        RESULT_VARIABLE result
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE error
+        OUTPUT_STRIP_TRAILING_WHITESPACE)
+    if (NOT result EQUAL 0)
+        message(WARNING "caste_detect: ${exe} failed: ${error}")
+        return()
+    endif()
+
+    string(REPLACE "\n" ";" lines "${output}")
+    foreach (line IN LISTS lines)
+        if (line MATCHES "^CASTE_?([A-Z_]*)=(.*)$")
+            set(name "${CMAKE_MATCH_1}")
+            if (name STREQUAL "")
+                set(name CASTE)
+            endif()
+            set(value "${CMAKE_MATCH_2}")
+            # Values that are not plain words are double-quoted with \" and \\ escapes.
+            if (value MATCHES "^\"(.*)\"$")
+                string(REGEX REPLACE "\\\\(.)" "\\1" value "${CMAKE_MATCH_1}")
+            endif()
+            set(${ARG_PREFIX}_${name} "${value}" PARENT_SCOPE)
+            set(_${name} "${value}")
+        endif()
+    endforeach()
+
+    set(${ARG_PREFIX}_JOB_POOLS "compile=${_COMPILE_JOBS};link=${_LINK_JOBS}" PARENT_SCOPE)
+    set(${ARG_PREFIX}_FOUND TRUE PARENT_SCOPE)
+    message(STATUS "caste_detect: ${_CASTE}, ${_ISA_LEVEL}, compile=${_COMPILE_JOBS} link=${_LINK_JOBS}")
+endfunction()
@@ -5,11 +5,60 @@ Caste inspects a user's machine and assigns it to a practical hardware category
 (Mini, User, Developer, Workstation, or Rig) to help set sensible application defaults.
 """
 
-from ._caste import __version__, detect_caste, detect_caste_word, detect_hw_facts
+import asyncio
+
+from ._caste import (
+    Caste,
+    CasteResult,
+    GpuKind,
+    HwFacts,
+    HwFlag,
+    __version__,
+    classify_caste,
+    classify_many,
+    detect_caste,
+    detect_caste_word,
+    _detect_in_background,
+    detect_hw_facts,
+    facts,
+    hw_flags,
+)
 
 __all__ = [
+    "Caste",
+    "CasteResult",
+    "GpuKind",
+    "HwFacts",
+    "HwFlag",
     "__version__",
+    "classify_caste",
+    "classify_many",
     "detect_caste",
     "detect_caste_word",
+    "detect_async",
     "detect_hw_facts",
+    "facts",
+    "hw_flags",
 ]
+
+
+def _deliver(future, hw, error):
+    if future.done():  # cancelled while detection ran
+        return
+    if error is not None:
+        future.set_exception(RuntimeError(f"hardware detection failed: {error}"))
+    else:
+        future.set_result(hw)
+
+
+def detect_async():
+    """Detect hardware facts on a native worker thread without blocking the event loop.
+
+    Returns an awaitable resolving to the same cached HwFacts as facts();
+    once detection has run, it resolves on the next loop iteration. A failed
+    detection raises RuntimeError and is retried by the next call.
+    """
+    loop = asyncio.get_running_loop()
+    future = loop.create_future()
+    _detect_in_background(lambda hw, error: loop.call_soon_threadsafe(_deliver, future, hw, error))
+    return future
@@ -1,33 +1,411 @@
 #include "caste.hpp"
 
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace py = pybind11;
 
+namespace {
+
+const char* gpu_kind_label(GpuKind k) {
+    switch (k) {
+        case GpuKind::None: return "None_";
+        case GpuKind::Integrated: return "Integrated";
+        case GpuKind::Unified: return "Unified";
+        case GpuKind::Discrete: return "Discrete";
+    }
+    return "None_";
+}
+
+std::string hw_facts_repr(const HwFacts& hw) {
+    return "HwFacts(ram_bytes=" + std::to_string(hw.ram_bytes) +
+           ", physical_cores=" + std::to_string(hw.physical_cores) +
+           ", logical_threads=" + std::to_string(hw.logical_threads) +
+           ", gpu_kind=GpuKind." + gpu_kind_label(hw.gpu_kind) +
+           ", vram_bytes=" + std::to_string(hw.vram_bytes) + ")";
+}
+
+// Keys of the dict detect_hw_facts() used to return, plus the newer fields.
+constexpr const char* kHwFactsKeys[] = {
+    "ram_bytes", "physical_cores", "logical_threads", "gpu_kind", "vram_bytes",
+    "has_discrete_gpu", "is_apple_silicon", "is_intel_arc", "is_virtual_machine", "cpu_steal_percent",
+};
+
+py::dict hw_facts_dict(const HwFacts& hw) {
+    py::dict d;
+    d["ram_bytes"] = py::int_(hw.ram_bytes);
+    d["physical_cores"] = py::int_(hw.physical_cores);
+    d["logical_threads"] = py::int_(hw.logical_threads);
+    d["gpu_kind"] = py::int_(static_cast<int>(hw.gpu_kind));
+    d["vram_bytes"] = py::int_(hw.vram_bytes);
+    d["has_discrete_gpu"] = py::bool_(hw.has_discrete_gpu);
+    d["is_apple_silicon"] = py::bool_(hw.is_apple_silicon);
+    d["is_intel_arc"] = py::bool_(hw.is_intel_arc);
+    d["is_virtual_machine"] = py::bool_(hw.is_virtual_machine);
+    d["cpu_steal_percent"] = py::int_(hw.cpu_steal_percent);
+    return d;
+}
+
+std::vector<std::string> reason_names(const CasteResult& r) {
+    std::vector<std::string> out;
+    for (CasteRule rule : kAllCasteRules) {
+        if (r.reasons.has(rule)) out.emplace_back(caste_rule_name(rule));
+    }
+    return out;
+}
+
+// Column arrays for classify_many(). With these dtypes and C-contiguous
+// input pybind11 passes the NumPy buffer through; other integer dtypes are
+// cast once.
+template <typename T>
+using Column = py::array_t<T, py::array::c_style | py::array::forcecast>;
+
+// Below this many records per thread, starting threads costs more than it saves.
+constexpr size_t kRecordsPerThread = size_t{1} << 16;
+
+// Floating columns are refused rather than cast: a pandas column with a NaN
+// is float64, and forcecast would turn the NaN into an arbitrary integer.
+template <typename T>
+std::optional<Column<T>> integer_column(const std::optional<py::array>& col, const char* name) {
+    if (!col) return std::nullopt;
+    const char kind = col->dtype().kind();
+    if (kind != 'i' && kind != 'u' && kind != 'b') {
+        throw py::value_error(std::string(name) + " must have an integer dtype, got " +
+                              py::str(col->dtype()).cast<std::string>());
+    }
+    return Column<T>::ensure(*col);
+}
+
+template <typename T>
+const T* column_data(const std::optional<Column<T>>& col, size_t n, const char* name) {
+    if (!col) return nullptr;
+    if (col->ndim() != 1 || static_cast<size_t>(col->shape(0)) != n) {
+        throw py::value_error(std::string(name) + " must be 1-D with the same length as ram_bytes");
+    }
+    return col->data();
+}
+
+py::array_t<uint8_t> classify_columns(const py::array& ram_bytes,
+                                      const std::optional<py::array>& physical_cores,
+                                      const std::optional<py::array>& logical_threads,
+                                      const std::optional<py::array>& vram_bytes,
+                                      const std::optional<py::array>& flag_bits,
+                                      const std::optional<py::array>& steal_percent,
+                                      int num_threads) {
+    const auto ram = integer_column<uint64_t>(ram_bytes, "ram_bytes");
+    const auto cores = integer_column<int32_t>(physical_cores, "physical_cores");
+    const auto threads = integer_column<int32_t>(logical_threads, "logical_threads");
+    const auto vram = integer_column<uint64_t>(vram_bytes, "vram_bytes");
+    const auto flags = integer_column<uint8_t>(flag_bits, "flags");
+    const auto steal = integer_column<uint8_t>(steal_percent, "cpu_steal_percent");
+    if (ram->ndim() != 1) throw py::value_error("ram_bytes must be 1-D");
+    const size_t n = static_cast<size_t>(ram->shape(0));
+
+    HwFactsColumns cols;
+    cols.count = n;
+    cols.ram_bytes = ram->data();
+    cols.physical_cores = column_data(cores, n, "physical_cores");
+    cols.logical_threads = column_data(threads, n, "logical_threads");
+    cols.vram_bytes = column_data(vram, n, "vram_bytes");
+    cols.flags = column_data(flags, n, "flags");
+    cols.cpu_steal_percent = column_data(steal, n, "cpu_steal_percent");
+
+    py::array_t<uint8_t> out(static_cast<py::ssize_t>(n));
+    uint8_t* dst = out.mutable_data();
+
+    size_t workers = num_threads > 0 ? static_cast<size_t>(num_threads)
+                                     : std::max(1u, std::thread::hardware_concurrency());
+    workers = std::max<size_t>(1, std::min(workers, n / kRecordsPerThread));
+
+    auto slice = [&](size_t begin, size_t end) {
+        HwFactsColumns part = cols;
+        part.count = end - begin;
+        part.ram_bytes += begin;
+        if (part.physical_cores) part.physical_cores += begin;
+        if (part.logical_threads) part.logical_threads += begin;
+        if (part.vram_bytes) part.vram_bytes += begin;
+        if (part.flags) part.flags += begin;
+        if (part.cpu_steal_percent) part.cpu_steal_percent += begin;
+        classify_many(part, dst + begin);
+    };
+
+    // The arrays stay alive in the caller's frame; only raw pointers are used here.
+    {
+        py::gil_scoped_release release;
+        std::vector<std::thread> pool;
+        const size_t per = (n + workers - 1) / workers;
+        for (size_t begin = per; begin < n; begin += per) {
+            pool.emplace_back(slice, begin, std::min(n, begin + per));
+        }
+        slice(0, std::min(n, per));
+        for (auto& t : pool) t.join();
+    }
+    return out;
+}
+
+// Process-wide detection result for facts() and detect_async(). At most one
+// detection runs at a time; callers that arrive meanwhile wait for it.
+// Waiters are Python callables, so they are only touched with the GIL held.
+struct FactsCache {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::optional<HwFacts> facts;
+    bool running = false;
+    std::thread worker;
+    std::vector<py::object> waiters;
+};
+
+FactsCache& facts_cache() {
+    static FactsCache* cache = new FactsCache; // never destroyed: may outlive the interpreter
+    return *cache;
+}
+
+// Ends a detection run: caches the facts if it succeeded, wakes facts()
+// callers either way (a failure is retried, not waited on forever), and
+// hands back the callbacks that were waiting for this run. Moving the
+// py::objects does not touch reference counts, so this needs no GIL.
+std::vector<py::object> finish_run(const std::optional<HwFacts>& hw) {
+    FactsCache& c = facts_cache();
+    std::vector<py::object> waiters;
+    {
+        std::lock_guard<std::mutex> lock(c.mu);
+        if (hw) c.facts = *hw;
+        c.running = false;
+        waiters.swap(c.waiters);
+    }
+    c.cv.notify_all();
+    return waiters;
+}
+
+// detect_hw_facts() reads sysfs through std::filesystem, which can throw.
+std::optional<HwFacts> run_detection(std::string& error) {
+    try {
+        return detect_hw_facts();
+    } catch (const std::exception& e) {
+        error = e.what();
+    } catch (...) {
+        error = "unknown error";
+    }
+    return std::nullopt;
+}
+
+// Calls each callback with (facts, None) or (None, error message). GIL held.
+void call_waiters(std::vector<py::object> waiters, const std::optional<HwFacts>& hw, const std::string& error) {
+    for (auto& cb : waiters) {
+        try {
+            cb(hw ? py::cast(*hw) : py::none(), hw ? py::none() : py::str(error));
+        } catch (py::error_already_set& e) {
+            e.discard_as_unraisable("caste detection callback");
+        }
+    }
+}
+
+// Cached facts, detecting (without the GIL) on first use. Failures raise
+// RuntimeError and are not cached.
+HwFacts cached_facts() {
+    FactsCache& c = facts_cache();
+    {
+        py::gil_scoped_release release;
+        std::unique_lock<std::mutex> lock(c.mu);
+        c.cv.wait(lock, [&] { return !c.running; });
+        if (c.facts) return *c.facts;
+        c.running = true;
+    }
+    std::optional<HwFacts> hw;
+    std::string error;
+    std::vector<py::object> waiters;
+    {
+        py::gil_scoped_release release;
+        hw = run_detection(error);
+        waiters = finish_run(hw);
+    }
+    call_waiters(std::move(waiters), hw, error);
+    if (!hw) throw std::runtime_error("hardware detection failed: " + error);
+    return *hw;
+}
+
+// Calls callback(facts, error) from a native worker thread once detection
+// is done, or right away when the facts are cached.
+void detect_in_background(py::object callback) {
+    FactsCache& c = facts_cache();
+    std::optional<HwFacts> cached;
+    std::thread previous; // a run that failed; joined below
+    {
+        std::lock_guard<std::mutex> lock(c.mu);
+        if (c.facts) {
+            cached = c.facts;
+        } else {
+            c.waiters.push_back(std::move(callback));
+            if (c.running) return; // the running detection calls it
+            c.running = true;
+            previous.swap(c.worker);
+            c.worker = std::thread([] {
+                std::string error;
+                const std::optional<HwFacts> hw = run_detection(error);
+                std::vector<py::object> waiters = finish_run(hw);
+                py::gil_scoped_acquire acquire;
+                call_waiters(std::move(waiters), hw, error);
+            });
+        }
+    }
+    if (cached) {
+        callback(*cached, py::none());
+        return;
+    }
+    if (previous.joinable()) {
+        py::gil_scoped_release release; // it may still be waiting for the GIL
+        previous.join();
+    }
+}
+
+// Registered with atexit: a worker must not take the GIL during shutdown.
+void join_worker() {
+    FactsCache& c = facts_cache();
+    std::thread worker;
+    {
+        std::lock_guard<std::mutex> lock(c.mu);
+        worker.swap(c.worker);
+    }
+    if (worker.joinable()) {
+        py::gil_scoped_release release;
+        worker.join();
+    }
+}
+
+} // namespace
+
 PYBIND11_MODULE(_caste, m) {
     m.doc() = "Caste hardware classification (native extension)";
 
-    m.def("detect_caste_word", &detect_caste_word,
+    py::enum_<Caste>(m, "Caste", "Hardware class, ordered from Mini to Rig.", py::arithmetic())
+        .value("Mini", Caste::Mini)
+        .value("User", Caste::User)
+        .value("Developer", Caste::Developer)
+        .value("Workstation", Caste::Workstation)
+        .value("Rig", Caste::Rig);
+
+    // "None" is a Python keyword, so that member is GpuKind.None_.
+    py::enum_<GpuKind>(m, "GpuKind", py::arithmetic())
+        .value("None_", GpuKind::None)
+        .value("Integrated", GpuKind::Integrated)
+        .value("Unified", GpuKind::Unified)
+        .value("Discrete", GpuKind::Discrete);
+
+    // Attributes read and write the C++ struct directly; nothing is copied
+    // into a dict. The read-only mapping methods (facts["ram_bytes"], get,
+    // keys, in, dict(facts), to_dict) keep code written against the old dict
+    // return value working.
+    py::class_<HwFacts>(m, "HwFacts", "Raw hardware facts; construct one to classify other machines.")
+        .def(py::init<>())
+        .def_readwrite("ram_bytes", &HwFacts::ram_bytes)
+        .def_readwrite("physical_cores", &HwFacts::physical_cores)
+        .def_readwrite("logical_threads", &HwFacts::logical_threads)
+        .def_readwrite("gpu_kind", &HwFacts::gpu_kind)
+        .def_readwrite("vram_bytes", &HwFacts::vram_bytes)
+        .def_readwrite("has_discrete_gpu", &HwFacts::has_discrete_gpu)
+        .def_readwrite("is_apple_silicon", &HwFacts::is_apple_silicon)
+        .def_readwrite("is_intel_arc", &HwFacts::is_intel_arc)
+        .def_readwrite("is_virtual_machine", &HwFacts::is_virtual_machine)
+        .def_readwrite("cpu_steal_percent", &HwFacts::cpu_steal_percent)
+        .def("__getitem__", [](const HwFacts& hw, const std::string& key) {
+            py::dict d = hw_facts_dict(hw);
+            if (!d.contains(key)) throw py::key_error(key);
+            return py::object(d[py::str(key)]);
+        })
+        .def("__contains__", [](const HwFacts&, const py::object& key) {
+            return py::isinstance<py::str>(key) &&
+                   std::find(std::begin(kHwFactsKeys), std::end(kHwFactsKeys), key.cast<std::string>()) !=
+                       std::end(kHwFactsKeys);
+        })
+        .def("__iter__", [](const HwFacts& hw) { return hw_facts_dict(hw).attr("__iter__")(); })
+        .def("__len__", [](const HwFacts&) { return std::size(kHwFactsKeys); })
+        .def("keys", [](const HwFacts& hw) { return hw_facts_dict(hw).attr("keys")(); })
+        .def("values", [](const HwFacts& hw) { return hw_facts_dict(hw).attr("values")(); })
+        .def("items", [](const HwFacts& hw) { return hw_facts_dict(hw).attr("items")(); })
+        .def("get", [](const HwFacts& hw, const std::string& key, py::object fallback) {
+            py::dict d = hw_facts_dict(hw);
+            return d.contains(key) ? py::object(d[py::str(key)]) : fallback;
+        }, py::arg("key"), py::arg("default") = py::none())
+        .def("to_dict", &hw_facts_dict, "Plain dict of the facts (gpu_kind as an int), e.g. for json.dumps.")
+        .def("__repr__", &hw_facts_repr);
+
+    py::class_<CasteResult>(m, "CasteResult", "A classification and the rules and numbers behind it.")
+        .def_readonly("caste", &CasteResult::caste)
+        .def_property_readonly("name", [](const CasteResult& r) { return caste_name(r.caste); })
+        .def_property_readonly("reason", &caste_reason_text, "Short human-readable explanation.")
+        .def_property_readonly("reasons", &reason_names, "Stable rule names, e.g. ['base_discrete_vram', 'ram_cap'].")
+        .def_readonly("base", &CasteResult::base)
+        .def_readonly("ram_cap", &CasteResult::ram_cap)
+        .def_readonly("cpu_cap", &CasteResult::cpu_cap)
+        .def_readonly("ram_bytes", &CasteResult::ram_bytes)
+        .def_readonly("vram_bytes", &CasteResult::vram_bytes)
+        .def_readonly("effective_cores", &CasteResult::effective_cores)
+        .def_readonly("logical_threads", &CasteResult::logical_threads)
+        .def_readonly("score", &CasteResult::score)
+        .def_readonly("memory_score", &CasteResult::memory_score)
+        .def_readonly("cpu_score", &CasteResult::cpu_score)
+        .def_readonly("gpu_score", &CasteResult::gpu_score)
+        .def("__repr__", [](const CasteResult& r) {
+            return std::string("CasteResult(caste=Caste.") + caste_name(r.caste) + ", reason='" +
+                   caste_reason_text(r) + "')";
+        });
+
+    // Detection can take a while (NVML load, sysfs walks), so it runs without
+    // the GIL; classification is constexpr arithmetic and keeps it.
+    m.def("detect_caste_word", &detect_caste_word, py::call_guard<py::gil_scoped_release>(),
         "Return the hardware classification as a single string (e.g., 'User', 'Developer').");
 
     m.def("detect_caste", []() {
-        CasteResult r = detect_caste();
-        return py::make_tuple(std::string(caste_name(r.caste)), r.reason);
+        CasteResult r;
+        {
+            py::gil_scoped_release release;
+            r = detect_caste();
+        }
+        return py::make_tuple(std::string(caste_name(r.caste)), caste_reason_text(r));
     }, "Return a tuple of (caste_name, reason_string) explaining the classification.");
 
-    m.def("detect_hw_facts", []() {
-        HwFacts hw = detect_hw_facts();
-        py::dict d;
-        d["ram_bytes"] = py::int_(hw.ram_bytes);
-        d["physical_cores"] = py::int_(hw.physical_cores);
-        d["logical_threads"] = py::int_(hw.logical_threads);
-        d["gpu_kind"] = py::int_(static_cast<int>(hw.gpu_kind));
-        d["vram_bytes"] = py::int_(hw.vram_bytes);
-        d["has_discrete_gpu"] = py::bool_(hw.has_discrete_gpu);
-        d["is_apple_silicon"] = py::bool_(hw.is_apple_silicon);
-        d["is_intel_arc"] = py::bool_(hw.is_intel_arc);
-        return d;
-    }, "Return a dictionary containing raw hardware facts detected on the system.");
+    m.def("detect_hw_facts", &detect_hw_facts, py::call_guard<py::gil_scoped_release>(),
+        "Detect the raw hardware facts of this machine.");
+
+    m.def("classify_caste", [](const HwFacts& hw) { return classify_caste(hw); }, py::arg("facts"),
+        "Classify hardware facts, detected or constructed by hand.");
+
+    py::enum_<HwFlag>(m, "HwFlag", py::arithmetic(), "Bits of the flags column for classify_many().")
+        .value("DiscreteGpu", HwFlag::DiscreteGpu)
+        .value("UnifiedMemory", HwFlag::UnifiedMemory)
+        .value("IntelArc", HwFlag::IntelArc)
+        .value("VirtualMachine", HwFlag::VirtualMachine);
+
+    m.def("hw_flags", [](const HwFacts& hw) { return hw_flags(hw); }, py::arg("facts"),
+        "The HwFlag bits of one record, for building a flags column.");
+
+    m.def("classify_many", &classify_columns,
+        py::arg("ram_bytes"), py::arg("physical_cores") = py::none(), py::arg("logical_threads") = py::none(),
+        py::arg("vram_bytes") = py::none(), py::arg("flags") = py::none(),
+        py::arg("cpu_steal_percent") = py::none(), py::kw_only(), py::arg("num_threads") = 0,
+        "Classify columns of hardware facts (NumPy arrays or anything with the buffer protocol).\n"
+        "Returns a uint8 array of Caste codes, identical to classify_caste() per record.\n"
+        "uint64 ram/vram, int32 cores/threads and uint8 flags/steal are read without copying;\n"
+        "other integer dtypes are converted once; floating dtypes raise ValueError. Missing\n"
+        "columns read as zero. Runs without the GIL, on num_threads threads (0 = one per CPU)\n"
+        "for large inputs.");
+
+    m.def("facts", &cached_facts,
+        "Hardware facts of this machine, detected once per process and cached.");
+    m.def("_detect_in_background", &detect_in_background, py::arg("callback"),
+        "Run detection on a native thread and call callback(facts, error) when done (see detect_async()).");
+    py::module_::import("atexit").attr("register")(py::cpp_function(&join_worker));
 
 #ifdef CASTE_VERSION
     m.attr("__version__") = CASTE_VERSION;
@@ -1,3 +1,8 @@
+import asyncio
+import json
+
+import pytest
+
 import caste
 
 
@@ -14,15 +19,142 @@ def test_detect_caste_tuple():
 
 def test_detect_hw_facts_shape():
     facts = caste.detect_hw_facts()
-    assert isinstance(facts, dict)
-    assert facts["ram_bytes"] >= 0
-    assert isinstance(facts["physical_cores"], int)
-    assert isinstance(facts["logical_threads"], int)
+    assert isinstance(facts, caste.HwFacts)
+    assert facts.ram_bytes >= 0
+    assert isinstance(facts.physical_cores, int)
+    assert isinstance(facts.logical_threads, int)
+    assert isinstance(facts.gpu_kind, caste.GpuKind)
+    assert facts.vram_bytes >= 0
+    assert isinstance(facts.has_discrete_gpu, bool)
+    assert isinstance(facts.is_apple_silicon, bool)
+    assert isinstance(facts.is_intel_arc, bool)
+    assert isinstance(facts.is_virtual_machine, bool)
+    assert 0 <= facts.cpu_steal_percent <= 100
+
+
+def test_hw_facts_item_access():
+    facts = caste.detect_hw_facts()
+    assert facts["ram_bytes"] == facts.ram_bytes
     assert facts["gpu_kind"] in {0, 1, 2, 3}
-    assert facts["vram_bytes"] >= 0
-    assert isinstance(facts["has_discrete_gpu"], bool)
-    assert isinstance(facts["is_apple_silicon"], bool)
-    assert isinstance(facts["is_intel_arc"], bool)
+    with pytest.raises(KeyError):
+        facts["no_such_key"]
+
+
+def test_hw_facts_dict_compatibility():
+    facts = caste.detect_hw_facts()
+    as_dict = facts.to_dict()
+    assert isinstance(as_dict, dict)
+    assert dict(facts) == as_dict
+    assert list(facts) == list(facts.keys()) == list(as_dict)
+    assert len(facts) == len(as_dict)
+    assert "ram_bytes" in facts
+    assert "no_such_key" not in facts
+    assert facts.get("vram_bytes") == facts.vram_bytes
+    assert facts.get("no_such_key", 7) == 7
+    assert isinstance(as_dict["physical_cores"], int)
+    assert isinstance(as_dict["has_discrete_gpu"], bool)
+    assert isinstance(as_dict["is_intel_arc"], bool)
+    assert json.loads(json.dumps(as_dict)) == as_dict
+
+
+def test_classify_constructed_facts():
+    facts = caste.HwFacts()
+    facts.ram_bytes = 64 * 1024**3
+    facts.physical_cores = 8
+    facts.logical_threads = 16
+    facts.gpu_kind = caste.GpuKind.Discrete
+    facts.has_discrete_gpu = True
+    facts.vram_bytes = 8 * 1024**3
+
+    result = caste.classify_caste(facts)
+    assert isinstance(result, caste.CasteResult)
+    assert result.caste == caste.Caste.Developer
+    assert result.name == "Developer"
+    assert "base_discrete_vram" in result.reasons
+    assert result.reason
+    assert result.score >= 200
+
+    facts.ram_bytes = 4 * 1024**3
+    assert caste.classify_caste(facts).caste == caste.Caste.Mini
+    assert caste.Caste.Mini < caste.Caste.Developer
+
+
+def test_detected_result_matches_word():
+    result = caste.classify_caste(caste.detect_hw_facts())
+    assert result.name == caste.detect_caste_word()
+
+
+def test_classify_many_matches_scalar():
+    np = pytest.importorskip("numpy")
+    rng = np.random.default_rng(7)
+    n = 200_000  # large enough to use several threads
+    ram = rng.integers(2, 256, n, dtype=np.uint64) * 1024**3
+    vram = rng.choice(np.array([0, 4, 8, 16, 24, 48], dtype=np.uint64), n) * 1024**3
+    cores = rng.integers(1, 32, n, dtype=np.int32)
+    threads = (cores * 2).astype(np.int32)
+    flags = rng.integers(0, 16, n, dtype=np.uint8)
+
+    codes = caste.classify_many(ram, cores, threads, vram, flags)
+    assert codes.dtype == np.uint8
+    assert codes.shape == (n,)
+    assert np.array_equal(codes, caste.classify_many(ram, cores, threads, vram, flags, num_threads=1))
+
+    for i in range(0, n, 9973):
+        facts = caste.HwFacts()
+        facts.ram_bytes = int(ram[i])
+        facts.physical_cores = int(cores[i])
+        facts.logical_threads = int(threads[i])
+        facts.vram_bytes = int(vram[i])
+        f = int(flags[i])
+        facts.has_discrete_gpu = bool(f & caste.HwFlag.DiscreteGpu)
+        facts.gpu_kind = (caste.GpuKind.Discrete if facts.has_discrete_gpu
+                          else caste.GpuKind.Unified if f & caste.HwFlag.UnifiedMemory
+                          else caste.GpuKind.Integrated)
+        facts.is_intel_arc = bool(f & caste.HwFlag.IntelArc)
+        facts.is_virtual_machine = bool(f & caste.HwFlag.VirtualMachine)
+        assert codes[i] == int(caste.classify_caste(facts).caste)
+        # DiscreteGpu wins over UnifiedMemory, so that bit does not round-trip.
+        if f & caste.HwFlag.DiscreteGpu:
+            f &= ~int(caste.HwFlag.UnifiedMemory)
+        assert caste.hw_flags(facts) == f
+
+
+def test_classify_many_checks_lengths():
+    np = pytest.importorskip("numpy")
+    with pytest.raises(ValueError):
+        caste.classify_many(np.zeros(3, dtype=np.uint64), np.zeros(2, dtype=np.int32))
+
+
+def test_classify_many_rejects_floating_columns():
+    np = pytest.importorskip("numpy")
+    ram = np.array([16 * 1024**3, np.nan])
+    with pytest.raises(ValueError):
+        caste.classify_many(ram)
+    with pytest.raises(ValueError):
+        caste.classify_many(np.zeros(2, dtype=np.uint64), physical_cores=np.array([8.0, np.nan]))
+
+
+def test_classify_many_accepts_other_integer_dtypes():
+    np = pytest.importorskip("numpy")
+    ram = np.full(3, 64 * 1024**3, dtype=np.int64)
+    cores = np.full(3, 16, dtype=np.int64)
+    expected = caste.classify_many(ram.astype(np.uint64), cores.astype(np.int32))
+    assert np.array_equal(caste.classify_many(ram, cores), expected)
+
+
+def test_detect_async_matches_cached_facts():
+    async def detect():
+        return await asyncio.gather(caste.detect_async(), caste.detect_async())
+
+    first, second = asyncio.run(detect())
+    assert isinstance(first, caste.HwFacts)
+    assert repr(first) == repr(second) == repr(caste.facts())
+
+
+def test_detect_async_raises_on_detection_error(monkeypatch):
+    monkeypatch.setattr(caste, "_detect_in_background", lambda callback: callback(None, "boom"))
+    with pytest.raises(RuntimeError, match="boom"):
+        asyncio.run(caste.detect_async())
 
 
 def test_version_string():
@@ -1,118 +1,239 @@
 #include "caste.hpp"
 
-static inline uint64_t GiB(uint64_t x) { return x * 1024ull * 1024ull * 1024ull; }
-static inline uint64_t MiB(uint64_t x) { return x * 1024ull * 1024ull; }
-static inline uint64_t ram_user_floor_bytes() { return GiB(8) - MiB(512); } // tolerate reserved memory
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <utility>
 
-static Caste min_caste(Caste a, Caste b) {
-    return (static_cast<int>(a) < static_cast<int>(b)) ? a : b;
-}
-static Caste max_caste(Caste a, Caste b) {
-    return (static_cast<int>(a) > static_cast<int>(b)) ? a : b;
-}
+using caste_detail::demote_caste;
 
-static Caste caste_from_vram(uint64_t vram_bytes) {
-    if (vram_bytes >= GiB(24)) return Caste::Rig;
-    if (vram_bytes >= GiB(16)) return Caste::Workstation;
-    if (vram_bytes >= GiB(6))  return Caste::Developer;
-    if (vram_bytes >= GiB(2))  return Caste::User;
-    return Caste::Mini; // dGPU with <2GB is basically Mini for modern local LLMs
-}
+namespace {
 
-// Clamp “how high you can go” by RAM, to avoid embarrassment.
-static Caste ram_cap(uint64_t ram_bytes) {
-    if (ram_bytes < ram_user_floor_bytes()) return Caste::Mini;
-    if (ram_bytes < GiB(16)) return Caste::User;
-    if (ram_bytes < GiB(24)) return Caste::User;        // 16–23GB: still usually “User”
-    if (ram_bytes < GiB(32)) return Caste::Developer;   // 24–31GB
-    if (ram_bytes < GiB(64)) return Caste::Workstation; // 32–63GB
-    return Caste::Rig;                                  // 64GB+
-}
+// Appends into a fixed buffer, counting what did not fit.
+struct ReasonWriter {
+    char* buf;
+    size_t cap;
+    size_t len = 0;
 
-// Optional clamp by CPU. Keep this gentle; RAM/GPU dominate.
-static Caste cpu_cap(int physical_cores, int logical_threads) {
-    // If you only have logical threads, pass physical_cores=0 and we’ll use threads.
-    const int cores = (physical_cores > 0) ? physical_cores : 0;
-    const int threads = logical_threads;
+    void append(const char* s) {
+        const size_t n = std::strlen(s);
+        if (cap > 0 && len < cap - 1) {
+            const size_t room = cap - 1 - len;
+            std::memcpy(buf + len, s, n < room ? n : room);
+        }
+        len += n;
+        if (cap > 0) buf[len < cap - 1 ? len : cap - 1] = '\0';
+    }
 
-    // Very low end
-    if ((cores > 0 && cores < 4) || (cores == 0 && threads > 0 && threads < 8)) {
-        return Caste::Mini;
+    // "7.5" for the default floor; keeps reason strings short.
+    void gb(uint64_t bytes) {
+        char tmp[32];
+        std::snprintf(tmp, sizeof(tmp), "%g", static_cast<double>(bytes) / static_cast<double>(caste_detail::GiB(1)));
+        append(tmp);
     }
 
-    // “User floor” (roughly 4c/8t)
-    if ((cores > 0 && cores < 6) || (cores == 0 && threads > 0 && threads < 12)) {
-        return Caste::User;
+    void num(int v) {
+        char tmp[16];
+        std::snprintf(tmp, sizeof(tmp), "%d", v);
+        append(tmp);
     }
+};
+
+} // namespace
 
-    // 6c/12t can be Developer or above, don’t cap further.
-    return Caste::Rig;
+const char* caste_rule_name(CasteRule rule) {
+    switch (rule) {
+        case CasteRule::RamFloor: return "ram_floor";
+        case CasteRule::BaseDiscreteVram: return "base_discrete_vram";
+        case CasteRule::BaseUnifiedRam: return "base_unified_ram";
+        case CasteRule::BaseIntegrated: return "base_integrated";
+        case CasteRule::ArcBump: return "arc_bump";
+        case CasteRule::ArcNoBump: return "arc_no_bump";
+        case CasteRule::VirtualCpus: return "virtual_cpus";
+        case CasteRule::RamCap: return "ram_cap";
+        case CasteRule::CpuCap: return "cpu_cap";
+        case CasteRule::OnBattery: return "on_battery";
+        case CasteRule::LowBattery: return "low_battery";
+        case CasteRule::LowPowerProfile: return "low_power_profile";
+        case CasteRule::SustainedReduced: return "sustained_reduced";
+        case CasteRule::SustainedLimited: return "sustained_limited";
+        case CasteRule::UserFloor: return "user_floor";
+        case CasteRule::BaseCpuCores: return "base_cpu_cores";
+        case CasteRule::MediaEngineBump: return "media_engine_bump";
+        case CasteRule::NoDiscreteGpu: return "no_discrete_gpu";
+    }
+    return nullptr;
 }
 
-CasteResult classify_caste(const HwFacts& hw) {
-    CasteResult out;
+// UserFloor is not rendered; the text predates it and tools grep for it.
+size_t format_caste_reason(const CasteResult& r, char* buf, size_t cap) {
+    const CasteReasons& why = r.reasons;
+    ReasonWriter w{buf, cap};
+    if (cap > 0) buf[0] = '\0';
 
-    // 0) Absolute floor
-    if (hw.ram_bytes < ram_user_floor_bytes()) {
-        out.caste = Caste::Mini;
-        out.reason = "RAM < ~7.5GB";
-        return out;
+    if (why.has(CasteRule::RamFloor)) {
+        w.append("RAM < ~");
+        w.gb(r.ram_floor_bytes);
+        w.append("GB");
+        return w.len;
     }
 
-    // 1) Base caste by GPU/memory model
-    Caste base = Caste::User;
+    if (why.has(CasteRule::BaseCpuCores)) w.append("CPU core count caste");
+    else if (why.has(CasteRule::BaseDiscreteVram)) w.append("discrete GPU VRAM caste");
+    else if (why.has(CasteRule::BaseUnifiedRam)) w.append("unified memory (Apple Silicon) caste by RAM");
+    else if (why.has(CasteRule::BaseIntegrated)) w.append("integrated GPU caste");
 
-    if (hw.gpu_kind == GpuKind::Discrete || hw.has_discrete_gpu) {
-        base = caste_from_vram(hw.vram_bytes);
-        out.reason = "discrete GPU VRAM caste";
-    } else if (hw.is_apple_silicon || hw.gpu_kind == GpuKind::Unified) {
-        // Apple Silicon: treat RAM as the main budget signal.
-        if (hw.ram_bytes >= GiB(64))      base = Caste::Rig;
-        else if (hw.ram_bytes >= GiB(32)) base = Caste::Workstation;
-        else if (hw.ram_bytes >= GiB(24)) base = Caste::Developer;
-        else                              base = Caste::User;
-        out.reason = "unified memory (Apple Silicon) caste by RAM";
-    } else {
-        // Integrated GPU (Intel/AMD iGPU): default to User if >=8GB RAM.
-        base = Caste::User;
-        out.reason = "integrated GPU caste";
+    if (why.has(CasteRule::ArcBump)) {
+        w.append("; Arc-class iGPU with >=");
+        w.gb(r.arc_bump_ram_bytes);
+        w.append("GB RAM => Developer floor");
+    } else if (why.has(CasteRule::ArcNoBump)) {
+        w.append("; Arc-class iGPU but <");
+        w.gb(r.arc_bump_ram_bytes);
+        w.append("GB RAM => no bump");
+    }
+    if (why.has(CasteRule::MediaEngineBump)) w.append("; GPU video encoder => bumped");
+    if (why.has(CasteRule::VirtualCpus)) {
+        w.append("; VM: ");
+        w.num(r.vcpus);
+        w.append(" vCPUs counted as ");
+        w.num(r.effective_cores);
+        w.append(" cores");
+        if (r.steal_percent > 0) {
+            w.append(" (");
+            w.num(r.steal_percent);
+            w.append("% steal)");
+        }
     }
+    if (why.has(CasteRule::RamCap)) w.append("; RAM cap applied");
+    if (why.has(CasteRule::CpuCap)) w.append("; CPU cap applied");
+    if (why.has(CasteRule::NoDiscreteGpu)) w.append("; no discrete GPU => capped at User");
+
+    if (why.has(CasteRule::OnBattery)) w.append("; on battery => demoted");
+    if (why.has(CasteRule::LowBattery)) w.append("; battery <20% => demoted");
+    if (why.has(CasteRule::LowPowerProfile)) w.append("; low-power profile => demoted");
+    if (why.has(CasteRule::SustainedReduced)) w.append("; sustained performance reduced => demoted");
+    if (why.has(CasteRule::SustainedLimited)) w.append("; sustained performance limited => demoted twice");
+
+    return w.len;
+}
+
+std::string caste_reason_text(const CasteResult& r) {
+    char buf[256];
+    size_t n = format_caste_reason(r, buf, sizeof(buf));
+    if (n < sizeof(buf)) return std::string(buf, n);
+    std::string out(n, '\0');
+    format_caste_reason(r, out.data(), n + 1);
+    return out;
+}
 
-    // 2) Intel Arc special-case
-    // - If Arc is DISCRETE, VRAM already handled above.
-    // - If Arc is integrated/unknown, allow a cautious bump only with enough RAM.
-    if (!hw.has_discrete_gpu && hw.gpu_kind != GpuKind::Discrete && hw.is_intel_arc) {
-        if (hw.ram_bytes >= GiB(16)) {
-            base = max_caste(base, Caste::Developer);
-            out.reason += "; Arc-class iGPU with >=16GB RAM => Developer floor";
-        } else {
-            out.reason += "; Arc-class iGPU but <16GB RAM => no bump";
+CasteResult classify_caste_power_aware(const HwFacts& hw, const PowerState& power,
+                                      const CastePolicy& policy) {
+    CasteResult out = classify_caste(hw, policy);
+    int steps = 0;
+
+    if (!power.on_ac) {
+        steps++;
+        out.reasons.add(CasteRule::OnBattery);
+        if (power.battery_percent >= 0 && power.battery_percent < 20) {
+            steps++;
+            out.reasons.add(CasteRule::LowBattery);
         }
     }
+    if (power.profile == PowerProfile::LowPower) {
+        steps++;
+        out.reasons.add(CasteRule::LowPowerProfile);
+    }
+
+    out.caste = demote_caste(out.caste, steps);
+    out.score = caste_detail::capability_score(out.caste, out.memory_score, out.cpu_score, out.gpu_score);
+    return out;
+}
 
-    // 3) Clamp by RAM (prevents “VRAM says Rig” when system RAM is too small)
-    Caste cap_ram = ram_cap(hw.ram_bytes);
-    Caste capped = min_caste(base, cap_ram);
+SustainedPerf sustained_performance(const ThermalState& t) {
+    const bool have_rapl = t.rapl_long_term_watts > 0.0;
+    const bool have_trips = t.min_trip_margin_c >= 0.0;
+    // More than one event per 10 minutes on average; any event when the window is unknown.
+    const double events = static_cast<double>(std::max(t.core_throttle_count, t.package_throttle_count));
+    const bool throttled = t.throttle_window_s > 0.0 ? events * 600.0 > t.throttle_window_s : events > 0.0;
+    if (t.zone_count == 0 && !have_rapl && !throttled) return SustainedPerf::Unknown;
 
-    // 4) Gentle CPU sanity clamp (optional but cheap)
-    Caste cap_cpu = cpu_cap(hw.physical_cores, hw.logical_threads);
-    capped = min_caste(capped, cap_cpu);
+    // Fanless tablets and Y-class parts sit at <=10W PL1; they hold boost for seconds.
+    // Without a fan, 15W U-class parts (fanless mini PCs) do no better. A missing
+    // fan is not held against higher limits: desktops often lack fan drivers.
+    const double limited_watts = t.has_fan ? 10.0 : 15.0;
+    if (have_rapl && t.rapl_long_term_watts <= limited_watts) return SustainedPerf::Limited;
+    if (throttled && have_trips && t.min_trip_margin_c < 5.0) return SustainedPerf::Limited;
 
-    // 5) Ensure we don’t return Mini if RAM >= 8GB unless everything is truly weak
-    // (You can remove this if you want harsher behavior)
-    if (hw.ram_bytes >= ram_user_floor_bytes()) {
-        capped = max_caste(capped, Caste::User);
+    if (throttled) return SustainedPerf::Reduced;
+    if (have_rapl && t.rapl_long_term_watts <= 30.0) return SustainedPerf::Reduced;
+    if (have_trips && t.min_trip_margin_c < 10.0) return SustainedPerf::Reduced;
+
+    return SustainedPerf::Full;
+}
+
+CasteResult classify_caste_sustained(const HwFacts& hw, const ThermalState& thermal,
+                                    const CastePolicy& policy) {
+    CasteResult out = classify_caste(hw, policy);
+    switch (sustained_performance(thermal)) {
+        case SustainedPerf::Reduced:
+            out.caste = demote_caste(out.caste, 1);
+            out.reasons.add(CasteRule::SustainedReduced);
+            break;
+        case SustainedPerf::Limited:
+            out.caste = demote_caste(out.caste, 2);
+            out.reasons.add(CasteRule::SustainedLimited);
+            break;
+        case SustainedPerf::Unknown:
+        case SustainedPerf::Full:
+            break;
     }
+    out.score = caste_detail::capability_score(out.caste, out.memory_score, out.cpu_score, out.gpu_score);
+    return out;
+}
+
+static float clamp_headroom(float v) {
+    return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
 
-    out.caste = capped;
+LiveCaste live_caste(Caste static_caste, const HwFacts& hw, const LoadSample& load) {
+    LiveCaste out;
 
-    // Improve reason string with caps applied
-    if (cap_ram != Caste::Rig) out.reason += "; RAM cap applied";
-    if (cap_cpu != Caste::Rig) out.reason += "; CPU cap applied";
+    if (load.loadavg_1min >= 0.0f && hw.logical_threads > 0) {
+        out.cpu_headroom = clamp_headroom(1.0f - load.loadavg_1min / static_cast<float>(hw.logical_threads));
+    }
+    if (load.psi_available) {
+        out.cpu_headroom = std::min(out.cpu_headroom, clamp_headroom(1.0f - load.cpu_some / 100.0f));
+        // "full" memory stalls mean nothing ran at all; weigh them heavier.
+        out.memory_headroom = clamp_headroom(1.0f - std::max(load.memory_some, 4.0f * load.memory_full) / 100.0f);
+        out.io_headroom = clamp_headroom(1.0f - std::max(load.io_some, 2.0f * load.io_full) / 100.0f);
+    }
 
+    const float worst = std::min({out.cpu_headroom, out.memory_headroom, out.io_headroom});
+    int steps = 0;
+    if (worst < 0.25f) steps = 2;
+    else if (worst < 0.5f) steps = 1;
+    out.caste = demote_caste(static_caste, steps);
     return out;
 }
 
+PowerMonitor::PowerMonitor(std::function<PowerState()> source)
+    : source_(std::move(source)), state_(source_()) {}
+
+void PowerMonitor::on_change(Callback cb) {
+    callbacks_.push_back(std::move(cb));
+}
+
+bool PowerMonitor::poll() {
+    PowerState now = source_();
+    if (now == state_) return false;
+    state_ = now;
+    for (auto& cb : callbacks_) cb(state_);
+    return true;
+}
+
 // Optional helper for display
 const char* caste_name(Caste t) {
     switch (t) {
@@ -125,6 +246,31 @@ const char* caste_name(Caste t) {
     return "Unknown";
 }
 
+const char* workload_name(Workload w) {
+    return workload_profile(w).name;
+}
+
+bool parse_workload(const std::string& name, Workload& out) {
+    for (const WorkloadProfile& p : kWorkloadProfiles) {
+        if (name == p.name) {
+            out = p.workload;
+            return true;
+        }
+    }
+    return false;
+}
+
+// PCIe 1.x/2.x use 8b/10b encoding, 3.x-5.x use 128b/130b, 6.x uses FLIT
+// mode (242 payload bytes out of 256).
+uint64_t pcie_link_bandwidth(double speed_gts, int width) {
+    if (speed_gts <= 0.0 || width <= 0) return 0;
+    double efficiency = 128.0 / 130.0;
+    if (speed_gts < 8.0) efficiency = 8.0 / 10.0;
+    else if (speed_gts >= 64.0) efficiency = 242.0 / 256.0;
+    const double bytes_per_lane = speed_gts * 1e9 * efficiency / 8.0;
+    return static_cast<uint64_t>(bytes_per_lane * width);
+}
+
 #if defined(__linux__)
 HwFacts fill_hw_facts_platform();
 #elif defined(__APPLE__) && defined(__MACH__)
@@ -151,3 +297,173 @@ std::string detect_caste_word() {
 HwFacts detect_hw_facts() {
     return fill_hw_facts_platform();
 }
+
+#if defined(__linux__)
+std::vector<GpuInfo> detect_gpus_platform();
+#else
+static std::vector<GpuInfo> detect_gpus_platform() {
+    return {};
+}
+#endif
+
+std::vector<GpuInfo> detect_gpus() {
+    return detect_gpus_platform();
+}
+
+#if defined(__linux__) || defined(_WIN32) || (defined(__APPLE__) && defined(__MACH__))
+VirtInfo detect_virtualization_platform();
+#else
+static VirtInfo detect_virtualization_platform() {
+    return VirtInfo{};
+}
+#endif
+
+VirtInfo detect_virtualization() {
+    return detect_virtualization_platform();
+}
+
+#if defined(__linux__) || defined(_WIN32)
+PowerState detect_power_state_platform();
+#else
+static PowerState detect_power_state_platform() {
+    return PowerState{};
+}
+#endif
+
+PowerState detect_power_state() {
+    return detect_power_state_platform();
+}
+
+#if defined(__linux__)
+LoadSample sample_load_platform();
+#else
+static LoadSample sample_load_platform() {
+    return LoadSample{};
+}
+#endif
+
+LoadSample sample_load() {
+    return sample_load_platform();
+}
+
+#if defined(__linux__)
+ThermalState detect_thermal_state_platform();
+#else
+static ThermalState detect_thermal_state_platform() {
+    return ThermalState{};
+}
+#endif
+
+ThermalState detect_thermal_state() {
+    return detect_thermal_state_platform();
+}
+
+#if defined(__linux__)
+CpuTopology detect_cpu_topology_platform();
+#else
+static CpuTopology detect_cpu_topology_platform() {
+    const HwFacts hw = fill_hw_facts_platform();
+    CpuTopology topo;
+    CpuGroup g;
+    g.cores = hw.physical_cores > 0 ? hw.physical_cores : hw.logical_threads;
+    for (int c = 0; c < hw.logical_threads; c++) g.cpus.push_back(c);
+    topo.allowed_threads = hw.logical_threads;
+    if (!g.cpus.empty()) topo.groups.push_back(std::move(g));
+    return topo;
+}
+#endif
+
+CpuTopology detect_cpu_topology() {
+    return detect_cpu_topology_platform();
+}
+
+#if defined(__linux__) || defined(_WIN32)
+MemoryFacts detect_memory_facts_platform();
+#else
+static MemoryFacts detect_memory_facts_platform() {
+    MemoryFacts mem;
+    mem.total_bytes = fill_hw_facts_platform().ram_bytes;
+    return mem;
+}
+#endif
+
+MemoryFacts detect_memory_facts() {
+    return detect_memory_facts_platform();
+}
+
+#if defined(__linux__)
+constexpr bool kSplitHwProbes = true;
+void refresh_hw_facts_platform(HwFacts& hw, uint8_t probes);
+int open_hw_events_platform();
+uint8_t read_hw_events_platform(int fd, int timeout_ms);
+void close_hw_events_platform(int fd);
+#else
+constexpr bool kSplitHwProbes = false;
+static void refresh_hw_facts_platform(HwFacts& hw, uint8_t probes) {
+    const HwFacts now = fill_hw_facts_platform();
+    if (probes & static_cast<uint8_t>(HwProbe::Memory)) hw.ram_bytes = now.ram_bytes;
+    if (probes & static_cast<uint8_t>(HwProbe::Cpu)) {
+        hw.physical_cores = now.physical_cores;
+        hw.logical_threads = now.logical_threads;
+        hw.is_virtual_machine = now.is_virtual_machine;
+        hw.cpu_steal_percent = now.cpu_steal_percent;
+    }
+    if (probes & static_cast<uint8_t>(HwProbe::Gpu)) {
+        hw.gpu_kind = now.gpu_kind;
+        hw.has_discrete_gpu = now.has_discrete_gpu;
+        hw.vram_bytes = now.vram_bytes;
+        hw.is_intel_arc = now.is_intel_arc;
+        hw.is_apple_silicon = now.is_apple_silicon;
+    }
+}
+static int open_hw_events_platform() { return -1; }
+static uint8_t read_hw_events_platform(int, int) { return 0; }
+static void close_hw_events_platform(int) {}
+#endif
+
+void refresh_hw_facts(HwFacts& hw, uint8_t probes) {
+    refresh_hw_facts_platform(hw, probes);
+}
+
+bool hw_probes_split() {
+    return kSplitHwProbes;
+}
+
+HwWatcher::HwWatcher(const CastePolicy& policy, Source source)
+    : policy_(policy), source_(std::move(source)) {
+    source_(facts_, kAllHwProbes);
+    result_ = classify_caste(facts_, policy_);
+    fd_ = open_hw_events_platform();
+}
+
+HwWatcher::~HwWatcher() {
+    close_hw_events_platform(fd_);
+}
+
+void HwWatcher::on_change(Callback cb) {
+    callbacks_.push_back(std::move(cb));
+}
+
+bool HwWatcher::poll(int timeout_ms) {
+    if (fd_ < 0) {
+        // Nothing to wait on: "forever" becomes the polling interval, not a busy loop.
+        if (timeout_ms < 0) timeout_ms = kHwPollIntervalMs;
+        if (timeout_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        return refresh(kAllHwProbes);
+    }
+    return refresh(read_hw_events_platform(fd_, timeout_ms) | static_cast<uint8_t>(HwProbe::Memory));
+}
+
+bool HwWatcher::refresh(uint8_t probes) {
+    source_(facts_, probes);
+    HwChange change;
+    change.previous = result_.caste;
+    change.probes = probes;
+    result_ = classify_caste(facts_, policy_);
+    if (result_.caste == change.previous) return false;
+
+    change.result = result_;
+    change.facts = facts_;
+    for (auto& cb : callbacks_) cb(change);
+    return true;
+}
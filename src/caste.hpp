@@ -1,7 +1,12 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 enum class Caste {
     Mini,
@@ -32,17 +37,1089 @@ struct HwFacts {
     bool has_discrete_gpu = false;    // convenience (often same as gpu_kind==Discrete)
     bool is_apple_silicon = false;    // macOS arm64
     bool is_intel_arc = false;        // Arc dGPU OR Arc-class iGPU (your detection decides)
+
+    // Virtualization (guest view). Unless the guest sees SMT siblings, each
+    // vCPU is assumed to be one host hyperthread.
+    bool is_virtual_machine = false;
+    uint8_t cpu_steal_percent = 0;    // CPU time taken by the hypervisor, 0-100
+};
+
+struct VirtInfo {
+    bool is_virtual_machine = false;
+    std::string hypervisor;           // "KVM", "VMware", "Hyper-V", "Xen", ... (empty if unknown)
+    std::string product;              // DMI product name, if readable
+    bool smt_exposed = false;         // guest topology shows hyperthread siblings
+    double steal_percent = 0.0;       // recent share, over >= 200ms (Linux /proc/stat)
+};
+
+// One entry per GPU found by the platform layer.
+struct GpuInfo {
+    uint32_t vendor_id = 0;           // PCI vendor (0x10de NVIDIA, 0x1002 AMD, 0x8086 Intel)
+    uint32_t device_id = 0;
+    GpuKind kind = GpuKind::None;
+    uint64_t vram_bytes = 0;          // 0 if unknown or shared memory
+    bool is_intel_arc = false;
+
+    // PCIe link as reported by the device (0 if unknown / not PCIe).
+    // Speeds are per-lane transfer rates in GT/s (2.5, 5, 8, 16, 32, 64).
+    double pcie_current_speed_gts = 0.0;
+    int pcie_current_width = 0;
+    double pcie_max_speed_gts = 0.0;
+    int pcie_max_width = 0;
+
+    // Estimated host-to-device bandwidth in bytes/s over the narrowest link
+    // between the root port and the GPU (risers, switches, slot wiring).
+    // Line-encoding overhead is removed; protocol overhead is not.
+    uint64_t host_to_device_bytes_per_sec = 0;
+};
+
+// PCI vendors whose integrated GPUs count as GPUs in HwFacts. Other display
+// adapters without VRAM (server BMCs such as ASPEED and Matrox, virtio-gpu,
+// bochs) only drive a console: enumerate_gpus() lists them, but HwFacts
+// reports GpuKind::None for a machine that has nothing else.
+constexpr bool is_gpu_vendor(uint32_t pci_vendor) {
+    return pci_vendor == 0x10de || pci_vendor == 0x1002 || pci_vendor == 0x8086;
+}
+
+enum class PowerProfile {
+    Unknown,
+    LowPower,     // "low-power", "quiet", "cool", Windows battery saver
+    Balanced,
+    Performance
+};
+
+struct PowerState {
+    bool has_battery = false;
+    bool on_ac = true;                // desktops and unknown sources count as AC
+    int battery_percent = -1;         // -1 if unknown
+    PowerProfile profile = PowerProfile::Unknown;
+
+    bool operator==(const PowerState&) const = default;
+};
+
+enum class SustainedPerf {
+    Unknown,      // no thermal/power data
+    Full,         // no sign the machine cannot hold its peak
+    Reduced,      // throttling seen, or a laptop-class power limit
+    Limited       // fanless-class power limit, or throttling near a trip point
+};
+
+struct ThermalState {
+    int zone_count = 0;
+    double max_temp_c = 0.0;                // hottest thermal zone right now
+    double min_trip_margin_c = -1.0;        // closest zone to a passive/hot/critical trip; -1 if unknown
+    uint64_t core_throttle_count = 0;       // highest per-CPU counter since boot
+    uint64_t package_throttle_count = 0;
+    double throttle_window_s = 0.0;         // time the counters cover (uptime); 0 if unknown
+    double rapl_long_term_watts = 0.0;      // RAPL PL1 of the package; 0 if unknown
+    double rapl_short_term_watts = 0.0;     // RAPL PL2
+    bool has_fan = false;                   // ACPI fan or hwmon fan sensor seen
+};
+
+// Raw live-load sample. PSI values are "avg10" percentages (share of the last
+// 10s in which some/all tasks stalled on the resource).
+struct LoadSample {
+    bool psi_available = false;
+    float cpu_some = 0.0f;
+    float memory_some = 0.0f;
+    float memory_full = 0.0f;
+    float io_some = 0.0f;
+    float io_full = 0.0f;
+    float loadavg_1min = -1.0f;       // -1 if unknown
+};
+
+struct LiveCaste {
+    Caste caste = Caste::Mini;        // static caste demoted by current load
+    float cpu_headroom = 1.0f;        // 0..1, share of capacity still free
+    float memory_headroom = 1.0f;
+    float io_headroom = 1.0f;
+};
+
+namespace caste_detail {
+constexpr uint64_t GiB(uint64_t x) { return x * 1024ull * 1024ull * 1024ull; }
+constexpr uint64_t MiB(uint64_t x) { return x * 1024ull * 1024ull; }
+} // namespace caste_detail
+
+// Thresholds evaluated by classify_caste(). Each table is indexed by caste
+// (Mini..Rig) and holds the minimum value needed to reach that caste, so
+// tables must be non-decreasing (see validate_policy()).
+struct CastePolicy {
+    using Table = std::array<uint64_t, 5>;
+
+    Table vram_min;          // discrete GPU base caste by VRAM
+    Table unified_ram_min;   // unified memory (Apple Silicon) base caste by RAM
+    Table ram_cap_min;       // clamp: highest caste allowed by system RAM
+    Table cpu_cores_min;     // clamp by physical cores
+    Table cpu_threads_min;   // clamp by logical threads when cores are unknown
+    uint64_t ram_floor;      // below this, Mini regardless of anything else
+    uint64_t arc_bump_ram;   // Arc-class iGPU with this much RAM => Developer floor
+};
+
+inline constexpr CastePolicy kDefaultCastePolicy = {
+    // dGPU with <2GB is basically Mini for modern local LLMs
+    {0, caste_detail::GiB(2), caste_detail::GiB(6), caste_detail::GiB(16), caste_detail::GiB(24)},
+    {0, 0, caste_detail::GiB(24), caste_detail::GiB(32), caste_detail::GiB(64)},
+    // 16–23GB is still usually “User”
+    {0, caste_detail::GiB(8) - caste_detail::MiB(512), caste_detail::GiB(24), caste_detail::GiB(32), caste_detail::GiB(64)},
+    {0, 4, 6, 6, 6},    // roughly 4c/8t is the User floor; 6c/12t does not cap further
+    {0, 8, 12, 12, 12},
+    caste_detail::GiB(8) - caste_detail::MiB(512), // tolerate reserved memory
+    caste_detail::GiB(16),
+};
+
+// Rules that shaped a classification, kept as bits so classify_caste() can
+// stay constexpr and allocation-free. Machine consumers switch on these;
+// caste_rule_name() gives stable identifiers and format_caste_reason() /
+// caste_reason_text() render the human text.
+enum class CasteRule : uint32_t {
+    RamFloor          = 1u << 0,   // RAM below policy.ram_floor => Mini
+    BaseDiscreteVram  = 1u << 1,
+    BaseUnifiedRam    = 1u << 2,
+    BaseIntegrated    = 1u << 3,
+    ArcBump           = 1u << 4,
+    ArcNoBump         = 1u << 5,
+    VirtualCpus       = 1u << 6,
+    RamCap            = 1u << 7,
+    CpuCap            = 1u << 8,
+    OnBattery         = 1u << 9,
+    LowBattery        = 1u << 10,
+    LowPowerProfile   = 1u << 11,
+    SustainedReduced  = 1u << 12,
+    SustainedLimited  = 1u << 13,
+    UserFloor         = 1u << 14,  // caps went below User but RAM lifted it back
+    BaseCpuCores      = 1u << 15,  // workload profiles with CasteBasis::CpuCores
+    MediaEngineBump   = 1u << 16,
+    NoDiscreteGpu     = 1u << 17,
+};
+
+inline constexpr CasteRule kAllCasteRules[] = {
+    CasteRule::RamFloor, CasteRule::BaseDiscreteVram, CasteRule::BaseUnifiedRam,
+    CasteRule::BaseIntegrated, CasteRule::ArcBump, CasteRule::ArcNoBump,
+    CasteRule::VirtualCpus, CasteRule::RamCap, CasteRule::CpuCap,
+    CasteRule::OnBattery, CasteRule::LowBattery, CasteRule::LowPowerProfile,
+    CasteRule::SustainedReduced, CasteRule::SustainedLimited, CasteRule::UserFloor,
+    CasteRule::BaseCpuCores, CasteRule::MediaEngineBump, CasteRule::NoDiscreteGpu,
+};
+
+struct CasteReasons {
+    uint32_t bits = 0;
+
+    constexpr bool has(CasteRule r) const { return (bits & static_cast<uint32_t>(r)) != 0; }
+    constexpr void add(CasteRule r) { bits |= static_cast<uint32_t>(r); }
+    constexpr bool empty() const { return bits == 0; }
 };
 
 struct CasteResult {
     Caste caste = Caste::Mini;
-    std::string reason; // for logs/UI
+    CasteReasons reasons;
+
+    // Intermediate castes: base from the GPU/memory model, then the clamps.
+    Caste base = Caste::Mini;
+    Caste ram_cap = Caste::Rig;
+    Caste cpu_cap = Caste::Rig;
+
+    // Inputs the rules compared, and thresholds the reason text quotes.
+    uint64_t ram_bytes = 0;
+    uint64_t vram_bytes = 0;
+    int effective_cores = 0;          // cores the CPU cap used (after any VM discount)
+    int logical_threads = 0;
+    int vcpus = 0;                    // VirtualCpus only
+    int steal_percent = 0;            // VirtualCpus only
+    uint64_t ram_floor_bytes = 0;
+    uint64_t arc_bump_ram_bytes = 0;
+
+    // Continuous capability for ranking hosts within a caste. Subscores are
+    // positions on the policy tables (1.0 = User threshold ... 4.0 = Rig,
+    // then +1 per doubling); score = 100 * caste + up to 99 from their mean,
+    // so it never crosses a caste boundary and never decreases with more
+    // RAM, VRAM or cores.
+    double score = 0.0;
+    double memory_score = 0.0;        // RAM on ram_cap_min
+    double cpu_score = 0.0;           // effective cores (or threads) on the CPU tables
+    double gpu_score = 0.0;           // VRAM, or unified RAM; 1.0 for integrated
+};
+
+namespace caste_detail {
+
+constexpr Caste min_caste(Caste a, Caste b) {
+    return (static_cast<int>(a) < static_cast<int>(b)) ? a : b;
+}
+constexpr Caste max_caste(Caste a, Caste b) {
+    return (static_cast<int>(a) > static_cast<int>(b)) ? a : b;
+}
+constexpr Caste demote_caste(Caste c, int steps) {
+    int v = static_cast<int>(c) - steps;
+    return static_cast<Caste>(v < 0 ? 0 : v);
+}
+
+// Highest caste whose minimum the value meets.
+constexpr Caste caste_from_table(const CastePolicy::Table& t, uint64_t value) {
+    for (int i = 4; i > 0; --i) {
+        if (value >= t[i]) return static_cast<Caste>(i);
+    }
+    return Caste::Mini;
+}
+
+// Optional clamp by CPU. Keep this gentle; RAM/GPU dominate.
+constexpr Caste cpu_cap(const CastePolicy& policy, int physical_cores, int logical_threads) {
+    // If you only have logical threads, pass physical_cores=0 and we’ll use threads.
+    if (physical_cores > 0) return caste_from_table(policy.cpu_cores_min, static_cast<uint64_t>(physical_cores));
+    if (logical_threads > 0) return caste_from_table(policy.cpu_threads_min, static_cast<uint64_t>(logical_threads));
+    return Caste::Rig;
+}
+
+// Piecewise-linear log2 for x >= 1, exact at powers of two.
+constexpr double log2_linear(double x) {
+    double e = 0.0;
+    while (x >= 2.0) {
+        x /= 2.0;
+        e += 1.0;
+    }
+    return e + (x - 1.0);
+}
+
+// k + fraction of the way from t[k] to t[k+1]; past t[4], 4 + log2(value / t[4]).
+constexpr double table_position(const CastePolicy::Table& t, uint64_t value) {
+    int k = 4;
+    while (k >= 0 && value < t[k]) --k;
+    if (k < 0) return 0.0;
+    if (k == 4) {
+        const double ratio = t[4] ? static_cast<double>(value) / static_cast<double>(t[4]) : 1.0;
+        return 4.0 + log2_linear(ratio < 1.0 ? 1.0 : ratio);
+    }
+    return k + static_cast<double>(value - t[k]) / static_cast<double>(t[k + 1] - t[k]);
+}
+
+constexpr double capability_score(Caste c, double memory, double cpu, double gpu) {
+    auto capped = [](double s) { return s < 8.0 ? s : 8.0; };
+    return 100.0 * static_cast<int>(c) + 99.0 * (capped(memory) + capped(cpu) + capped(gpu)) / 24.0;
+}
+
+// Subscores from the same inputs the rules used; needs out.caste and
+// out.effective_cores to be final.
+constexpr void fill_scores(CasteResult& out, const HwFacts& hw, const CastePolicy& policy) {
+    out.memory_score = table_position(policy.ram_cap_min, hw.ram_bytes);
+
+    if (out.effective_cores > 0) {
+        out.cpu_score = table_position(policy.cpu_cores_min, static_cast<uint64_t>(out.effective_cores));
+    } else if (hw.logical_threads > 0) {
+        out.cpu_score = table_position(policy.cpu_threads_min, static_cast<uint64_t>(hw.logical_threads));
+    } else {
+        out.cpu_score = 4.0;          // unknown CPU does not cap either
+    }
+
+    if (hw.gpu_kind == GpuKind::Discrete || hw.has_discrete_gpu) {
+        out.gpu_score = table_position(policy.vram_min, hw.vram_bytes);
+    } else if (hw.is_apple_silicon || hw.gpu_kind == GpuKind::Unified) {
+        const double unified = table_position(policy.unified_ram_min, hw.ram_bytes);
+        out.gpu_score = unified < 1.0 ? 1.0 : unified;
+    } else {
+        out.gpu_score = out.reasons.has(CasteRule::ArcBump) ? 2.0 : 1.0;
+    }
+
+    out.score = capability_score(out.caste, out.memory_score, out.cpu_score, out.gpu_score);
+}
+
+constexpr bool table_is_monotonic(const CastePolicy::Table& t) {
+    for (size_t i = 1; i < t.size(); i++) {
+        if (t[i] < t[i - 1]) return false;
+    }
+    return true;
+}
+
+} // namespace caste_detail
+
+constexpr bool policy_is_monotonic(const CastePolicy& p) {
+    return caste_detail::table_is_monotonic(p.vram_min) &&
+           caste_detail::table_is_monotonic(p.unified_ram_min) &&
+           caste_detail::table_is_monotonic(p.ram_cap_min) &&
+           caste_detail::table_is_monotonic(p.cpu_cores_min) &&
+           caste_detail::table_is_monotonic(p.cpu_threads_min);
+}
+
+static_assert(policy_is_monotonic(kDefaultCastePolicy), "default caste policy must be monotonic");
+
+// Pure arithmetic over HwFacts: usable in static_assert and never allocates.
+constexpr CasteResult classify_caste(const HwFacts& hw, const CastePolicy& policy) {
+    using namespace caste_detail;
+    CasteResult out;
+    out.ram_bytes = hw.ram_bytes;
+    out.vram_bytes = hw.vram_bytes;
+    out.effective_cores = hw.physical_cores;
+    out.logical_threads = hw.logical_threads;
+    out.ram_floor_bytes = policy.ram_floor;
+    out.arc_bump_ram_bytes = policy.arc_bump_ram;
+
+    // 1) Base caste by GPU/memory model
+    Caste base = Caste::User;
+
+    if (hw.gpu_kind == GpuKind::Discrete || hw.has_discrete_gpu) {
+        base = caste_from_table(policy.vram_min, hw.vram_bytes);
+        out.reasons.add(CasteRule::BaseDiscreteVram);
+    } else if (hw.is_apple_silicon || hw.gpu_kind == GpuKind::Unified) {
+        // Apple Silicon: treat RAM as the main budget signal.
+        base = max_caste(caste_from_table(policy.unified_ram_min, hw.ram_bytes), Caste::User);
+        out.reasons.add(CasteRule::BaseUnifiedRam);
+    } else {
+        // Integrated GPU (Intel/AMD iGPU): default to User if >=8GB RAM.
+        base = Caste::User;
+        out.reasons.add(CasteRule::BaseIntegrated);
+    }
+
+    // 2) Intel Arc special-case
+    // - If Arc is DISCRETE, VRAM already handled above.
+    // - If Arc is integrated/unknown, allow a cautious bump only with enough RAM.
+    if (!hw.has_discrete_gpu && hw.gpu_kind != GpuKind::Discrete && hw.is_intel_arc) {
+        if (hw.ram_bytes >= policy.arc_bump_ram) {
+            base = max_caste(base, Caste::Developer);
+            out.reasons.add(CasteRule::ArcBump);
+        } else {
+            out.reasons.add(CasteRule::ArcNoBump);
+        }
+    }
+
+    // 3) Clamp by RAM (prevents “VRAM says Rig” when system RAM is too small)
+    Caste cap_ram = caste_from_table(policy.ram_cap_min, hw.ram_bytes);
+    Caste capped = min_caste(base, cap_ram);
+
+    // 4) Gentle CPU sanity clamp (optional but cheap)
+    // In a VM, count vCPUs as host hyperthreads and discount steal time.
+    int cores = hw.physical_cores;
+    if (hw.is_virtual_machine) {
+        const bool smt_exposed = hw.physical_cores > 0 && hw.physical_cores < hw.logical_threads;
+        const int vcpus = (hw.logical_threads > 0) ? hw.logical_threads : hw.physical_cores;
+        if (!smt_exposed) cores = vcpus / 2;
+        const int steal = hw.cpu_steal_percent > 100 ? 100 : hw.cpu_steal_percent;
+        cores = cores * (100 - steal) / 100;
+        if (cores < 1 && vcpus > 0) cores = 1;
+        out.reasons.add(CasteRule::VirtualCpus);
+        out.vcpus = vcpus;
+        out.effective_cores = cores;
+        out.steal_percent = steal;
+    }
+    Caste cap_cpu = cpu_cap(policy, cores, hw.logical_threads);
+    capped = min_caste(capped, cap_cpu);
+
+    out.base = base;
+    out.ram_cap = cap_ram;
+    out.cpu_cap = cap_cpu;
+
+    // 5) Absolute floor. The intermediate castes above are still reported,
+    // but the floor is the only rule that shaped the result.
+    if (hw.ram_bytes < policy.ram_floor) {
+        out.caste = Caste::Mini;
+        out.reasons = CasteReasons{};
+        out.reasons.add(CasteRule::RamFloor);
+        fill_scores(out, hw, policy);
+        return out;
+    }
+
+    // 6) Ensure we don’t return Mini if RAM >= 8GB unless everything is truly weak
+    // (You can remove this if you want harsher behavior)
+    if (hw.ram_bytes >= policy.ram_floor && capped == Caste::Mini) {
+        capped = Caste::User;
+        out.reasons.add(CasteRule::UserFloor);
+    }
+
+    out.caste = capped;
+    fill_scores(out, hw, policy);
+
+    if (cap_ram != Caste::Rig) out.reasons.add(CasteRule::RamCap);
+    if (cap_cpu != Caste::Rig) out.reasons.add(CasteRule::CpuCap);
+
+    return out;
+}
+
+constexpr CasteResult classify_caste(const HwFacts& hw) {
+    return classify_caste(hw, kDefaultCastePolicy);
+}
+
+// ---- Workload profiles ----
+//
+// The default rules are tuned for local LLM inference (VRAM first). Other
+// workloads are limited by other resources, so each profile picks which one
+// sets the base caste and brings its own thresholds; the RAM floor and the
+// RAM/CPU clamps work as in classify_caste().
+
+enum class Workload {
+    LlmInference,
+    VideoTranscode,
+    Compile,
+    Training,
+};
+
+enum class CasteBasis : uint8_t {
+    GpuMemory,    // VRAM / unified memory, as classify_caste()
+    CpuCores,     // effective cores on cpu_cores_min (threads if cores unknown)
+};
+
+struct WorkloadProfile {
+    Workload workload = Workload::LlmInference;
+    const char* name = "";
+    CasteBasis basis = CasteBasis::GpuMemory;
+    bool media_engine_bump = false;   // one step up with a GPU video encoder
+    bool needs_discrete_gpu = false;  // integrated-only machines stop at User
+    CastePolicy policy = kDefaultCastePolicy;
 };
 
-CasteResult classify_caste(const HwFacts& hw);
+inline constexpr WorkloadProfile kWorkloadProfiles[] = {
+    {Workload::LlmInference, "llm_inference", CasteBasis::GpuMemory, false, false, kDefaultCastePolicy},
+    // Encoders scale with cores, and any GPU adds a hardware encoder; frames
+    // need little RAM.
+    {Workload::VideoTranscode, "video_transcode", CasteBasis::CpuCores, true, false, {
+        kDefaultCastePolicy.vram_min,
+        kDefaultCastePolicy.unified_ram_min,
+        {0, caste_detail::GiB(8) - caste_detail::MiB(512), caste_detail::GiB(16), caste_detail::GiB(16), caste_detail::GiB(32)},
+        {0, 4, 8, 12, 16},
+        {0, 8, 16, 24, 32},
+        kDefaultCastePolicy.ram_floor,
+        kDefaultCastePolicy.arc_bump_ram,
+    }},
+    // Parallel C++ builds: cores, and about 2GiB of RAM per job.
+    {Workload::Compile, "compile", CasteBasis::CpuCores, false, false, {
+        kDefaultCastePolicy.vram_min,
+        kDefaultCastePolicy.unified_ram_min,
+        {0, caste_detail::GiB(8) - caste_detail::MiB(512), caste_detail::GiB(16), caste_detail::GiB(32), caste_detail::GiB(64)},
+        {0, 4, 8, 16, 24},
+        {0, 8, 16, 32, 48},
+        kDefaultCastePolicy.ram_floor,
+        kDefaultCastePolicy.arc_bump_ram,
+    }},
+    // Training holds weights, gradients and optimizer state: roughly twice
+    // the VRAM of inference, and a discrete (or unified) GPU.
+    {Workload::Training, "training", CasteBasis::GpuMemory, false, true, {
+        {0, caste_detail::GiB(4), caste_detail::GiB(12), caste_detail::GiB(24), caste_detail::GiB(48)},
+        {0, 0, caste_detail::GiB(32), caste_detail::GiB(64), caste_detail::GiB(128)},
+        {0, caste_detail::GiB(8) - caste_detail::MiB(512), caste_detail::GiB(32), caste_detail::GiB(64), caste_detail::GiB(128)},
+        {0, 4, 8, 8, 12},
+        {0, 8, 16, 16, 24},
+        kDefaultCastePolicy.ram_floor,
+        kDefaultCastePolicy.arc_bump_ram,
+    }},
+};
+
+// workload_profile() indexes the table by enum value.
+static_assert(sizeof(kWorkloadProfiles) / sizeof(kWorkloadProfiles[0]) == 4, "one profile per Workload");
+static_assert(kWorkloadProfiles[0].workload == Workload::LlmInference &&
+              std::string_view(kWorkloadProfiles[0].name) == "llm_inference", "kWorkloadProfiles[0]");
+static_assert(kWorkloadProfiles[1].workload == Workload::VideoTranscode &&
+              std::string_view(kWorkloadProfiles[1].name) == "video_transcode", "kWorkloadProfiles[1]");
+static_assert(kWorkloadProfiles[2].workload == Workload::Compile &&
+              std::string_view(kWorkloadProfiles[2].name) == "compile", "kWorkloadProfiles[2]");
+static_assert(kWorkloadProfiles[3].workload == Workload::Training &&
+              std::string_view(kWorkloadProfiles[3].name) == "training", "kWorkloadProfiles[3]");
+
+static_assert(policy_is_monotonic(kWorkloadProfiles[1].policy) &&
+              policy_is_monotonic(kWorkloadProfiles[2].policy) &&
+              policy_is_monotonic(kWorkloadProfiles[3].policy),
+              "workload policies must be monotonic");
+
+constexpr const WorkloadProfile& workload_profile(Workload w) {
+    return kWorkloadProfiles[static_cast<int>(w)];
+}
+
+constexpr CasteResult classify_workload(const HwFacts& hw, const WorkloadProfile& profile) {
+    using namespace caste_detail;
+    CasteResult out = classify_caste(hw, profile.policy);
+    if (out.reasons.has(CasteRule::RamFloor)) return out;
+
+    const bool discrete = hw.gpu_kind == GpuKind::Discrete || hw.has_discrete_gpu;
+    const bool unified = hw.is_apple_silicon || hw.gpu_kind == GpuKind::Unified;
+
+    if (profile.basis == CasteBasis::CpuCores) {
+        // The CPU cap already holds the core rank (VM discount included);
+        // with no CPU information there is nothing to rank, so start at User.
+        const bool cpu_known = out.effective_cores > 0 || hw.logical_threads > 0;
+        Caste base = cpu_known ? out.cpu_cap : Caste::User;
+        out.reasons.bits &= ~(static_cast<uint32_t>(CasteRule::BaseDiscreteVram) |
+                              static_cast<uint32_t>(CasteRule::BaseUnifiedRam) |
+                              static_cast<uint32_t>(CasteRule::BaseIntegrated) |
+                              static_cast<uint32_t>(CasteRule::ArcBump) |
+                              static_cast<uint32_t>(CasteRule::ArcNoBump) |
+                              static_cast<uint32_t>(CasteRule::CpuCap) |
+                              static_cast<uint32_t>(CasteRule::UserFloor));
+        out.reasons.add(CasteRule::BaseCpuCores);
+
+        // Integrated means an Intel, AMD or NVIDIA iGPU (see is_gpu_vendor());
+        // console-only adapters are reported as None and have no encoder.
+        if (profile.media_engine_bump && (discrete || unified || hw.gpu_kind == GpuKind::Integrated)) {
+            base = min_caste(demote_caste(base, -1), Caste::Rig);  // one step up
+            out.reasons.add(CasteRule::MediaEngineBump);
+        }
+
+        out.base = base;
+        out.cpu_cap = Caste::Rig;
+        out.caste = min_caste(base, out.ram_cap);
+        if (out.caste == Caste::Mini) {
+            out.caste = Caste::User;
+            out.reasons.add(CasteRule::UserFloor);
+        }
+    } else if (profile.needs_discrete_gpu && !discrete && !unified && out.caste > Caste::User) {
+        out.caste = Caste::User;
+        out.reasons.add(CasteRule::NoDiscreteGpu);
+    }
+
+    out.score = capability_score(out.caste, out.memory_score, out.cpu_score, out.gpu_score);
+    return out;
+}
+
+constexpr CasteResult classify_workload(const HwFacts& hw, Workload w) {
+    return classify_workload(hw, workload_profile(w));
+}
+
+// "llm_inference", "video_transcode", "compile", "training".
+const char* workload_name(Workload w);
+bool parse_workload(const std::string& name, Workload& out);
+
 const char* caste_name(Caste t);
 
+// ---- Batch classification (fleet telemetry) ----
+
+// Bits of HwFactsColumns::flags. Values are part of the API (NumPy and
+// file formats use them directly).
+enum class HwFlag : uint8_t {
+    DiscreteGpu    = 1u << 0,  // gpu_kind == Discrete || has_discrete_gpu
+    UnifiedMemory  = 1u << 1,  // gpu_kind == Unified || is_apple_silicon
+    IntelArc       = 1u << 2,
+    VirtualMachine = 1u << 3,
+};
+
+constexpr uint8_t hw_flags(const HwFacts& hw) {
+    uint8_t f = 0;
+    if (hw.gpu_kind == GpuKind::Discrete || hw.has_discrete_gpu) f |= static_cast<uint8_t>(HwFlag::DiscreteGpu);
+    if (hw.gpu_kind == GpuKind::Unified || hw.is_apple_silicon) f |= static_cast<uint8_t>(HwFlag::UnifiedMemory);
+    if (hw.is_intel_arc) f |= static_cast<uint8_t>(HwFlag::IntelArc);
+    if (hw.is_virtual_machine) f |= static_cast<uint8_t>(HwFlag::VirtualMachine);
+    return f;
+}
+
+// Structure-of-arrays view over `count` records. ram_bytes is required; any
+// other column may be null and then reads as 0.
+struct HwFactsColumns {
+    size_t count = 0;
+    const uint64_t* ram_bytes = nullptr;
+    const int32_t* physical_cores = nullptr;
+    const int32_t* logical_threads = nullptr;
+    const uint64_t* vram_bytes = nullptr;
+    const uint8_t* flags = nullptr;             // HwFlag bits
+    const uint8_t* cpu_steal_percent = nullptr;
+};
+
+constexpr HwFacts hw_facts_from_columns(const HwFactsColumns& c, size_t i) {
+    HwFacts hw{};
+    hw.ram_bytes = c.ram_bytes[i];
+    hw.physical_cores = c.physical_cores ? c.physical_cores[i] : 0;
+    hw.logical_threads = c.logical_threads ? c.logical_threads[i] : 0;
+    hw.vram_bytes = c.vram_bytes ? c.vram_bytes[i] : 0;
+    const uint8_t f = c.flags ? c.flags[i] : 0;
+    const bool discrete = (f & static_cast<uint8_t>(HwFlag::DiscreteGpu)) != 0;
+    hw.has_discrete_gpu = discrete;
+    hw.gpu_kind = discrete ? GpuKind::Discrete
+                : (f & static_cast<uint8_t>(HwFlag::UnifiedMemory)) ? GpuKind::Unified
+                : GpuKind::Integrated;
+    hw.is_intel_arc = (f & static_cast<uint8_t>(HwFlag::IntelArc)) != 0;
+    hw.is_virtual_machine = (f & static_cast<uint8_t>(HwFlag::VirtualMachine)) != 0;
+    hw.cpu_steal_percent = c.cpu_steal_percent ? c.cpu_steal_percent[i] : 0;
+    return hw;
+}
+
+// Writes static_cast<uint8_t>(classify_caste(record, policy).caste) for
+// every record into out[0..count). Branch-free and laid out for compiler
+// auto-vectorization; results are identical to the scalar path.
+void classify_many(const HwFactsColumns& in, uint8_t* out,
+                   const CastePolicy& policy = kDefaultCastePolicy);
+
+// Telemetry records as caste-fleet reads them: CSV whose header names HwFacts
+// members, or NDJSON objects with those keys. Unknown columns and keys are
+// ignored; ram_bytes is required. gpu_kind takes names or 0-3 and flags
+// true/false/1/0/yes/no; both may be empty. Numbers may be decimals.
+enum class FleetFormat { Csv, Ndjson };
+enum class FleetField : uint8_t;
+
+class FleetRecordParser {
+public:
+    explicit FleetRecordParser(FleetFormat format);
+
+    // CSV only: the header line. False if it has no ram_bytes column.
+    bool set_header(std::string_view line);
+    // One line without its newline ('\r' and surrounding blanks are ignored).
+    // False if it is malformed or, for CSV, has a different column count.
+    bool parse(std::string_view line, HwFacts& out) const;
+
+private:
+    FleetFormat format_;
+    std::vector<FleetField> columns_;
+};
+
+constexpr size_t kFleetChunkBytes = size_t{16} << 20;
+
+struct FleetChunk {
+    uint64_t lines = 0;                 // physical lines, blank ones included
+    uint64_t counts[5] = {};            // records per caste
+    uint64_t invalid = 0;
+    uint64_t first_invalid_line = 0;    // 1-based within the chunk; 0 if none
+    std::string records;                // one caste name or "invalid" per record, if asked for
+};
+
+// Parses and classifies whole lines of text (blank lines are skipped).
+FleetChunk classify_fleet_chunk(const FleetRecordParser& parser, std::string_view text,
+                                const CastePolicy& policy = kDefaultCastePolicy, bool want_records = false);
+
+// Where the chunk starting at `begin` ends: chunk_bytes later, moved just
+// past the next newline so no record is split, or at `size`.
+size_t fleet_chunk_end(const char* data, size_t size, size_t begin, size_t chunk_bytes = kFleetChunkBytes);
+
+// Stable snake_case identifier, e.g. "ram_cap"; nullptr for unknown values.
+const char* caste_rule_name(CasteRule rule);
+
+// Human-readable explanation, e.g. "discrete GPU VRAM caste; RAM cap applied".
+// format_caste_reason() writes into a caller buffer without allocating and
+// returns the full length (like snprintf; output is truncated to cap-1).
+size_t format_caste_reason(const CasteResult& result, char* buf, size_t cap);
+std::string caste_reason_text(const CasteResult& result);
+
+// Policy loading. The text format is one "key = value" per line ('#' starts
+// a comment); table keys take five values (Mini..Rig) and sizes accept
+// B/KiB/MiB/GiB/TiB suffixes, e.g.
+//
+//     vram_min = 0 2GiB 8GiB 16GiB 24GiB
+//     ram_floor = 7.5GiB
+//
+// Keys not given keep their kDefaultCastePolicy value. Returns false and
+// fills *error on syntax errors or when validate_policy() fails.
+bool validate_policy(const CastePolicy& policy, std::string* error = nullptr);
+bool parse_policy(const std::string& text, CastePolicy& out, std::string* error = nullptr);
+bool load_policy_file(const std::string& path, CastePolicy& out, std::string* error = nullptr);
+
+// Byte sizes as policy files write them: "24GiB", "7.5G", "512MiB", "4096".
+bool parse_size_bytes(const std::string& text, uint64_t& out);
+
+// Instruction set level of this CPU (with OS support for its registers), as
+// a -march value: "x86-64", "x86-64-v2", "x86-64-v3" or "x86-64-v4" (psABI
+// levels), "armv8-a" on AArch64, and "" elsewhere.
+const char* detect_isa_level();
+
 // Simple public API: call this and get a single word bucket name.
 HwFacts detect_hw_facts();
 CasteResult detect_caste();
 std::string detect_caste_word();
+
+// Hypervisor presence (cpuid, /sys/hypervisor, DMI) and steal time.
+VirtInfo detect_virtualization();
+
+// Power source and platform profile (Linux sysfs, Windows; AC elsewhere).
+PowerState detect_power_state();
+
+// Same as classify_caste(), then demotes one step on battery, one more when
+// the battery is below 20%, and one for a low-power platform profile.
+CasteResult classify_caste_power_aware(const HwFacts& hw, const PowerState& power,
+                                      const CastePolicy& policy = kDefaultCastePolicy);
+
+// Change notification for power state. Nothing runs in the background:
+// call poll() from your own timer (every few seconds is plenty) and the
+// registered callbacks fire when the state differs from the last poll.
+class PowerMonitor {
+public:
+    using Callback = std::function<void(const PowerState&)>;
+
+    explicit PowerMonitor(std::function<PowerState()> source = detect_power_state);
+
+    void on_change(Callback cb);
+    bool poll(); // true if the state changed (callbacks have been invoked)
+    const PowerState& state() const { return state_; }
+
+private:
+    std::function<PowerState()> source_;
+    std::vector<Callback> callbacks_;
+    PowerState state_;
+};
+
+// Thermal zones, throttle counters and RAPL limits (Linux; empty elsewhere).
+// sustained_performance() counts throttling as a rate over
+// throttle_window_s, so a few events at boot wear off; to judge a specific
+// interval, subtract an earlier sample's counters and set the window to the
+// time between them.
+ThermalState detect_thermal_state();
+SustainedPerf sustained_performance(const ThermalState& thermal);
+
+// For long-running workloads: classify_caste(), then demote one step for
+// Reduced and two for Limited sustained performance.
+CasteResult classify_caste_sustained(const HwFacts& hw, const ThermalState& thermal,
+                                    const CastePolicy& policy = kDefaultCastePolicy);
+
+// Live load for adaptive schedulers. sample_load() does one read per
+// /proc/pressure/{cpu,memory,io} and /proc/loadavg into stack buffers and
+// never allocates, so it is fine to call every few seconds. live_caste()
+// demotes a cached static caste by one step when any headroom drops below
+// 50% and by two below 25%.
+LoadSample sample_load();
+LiveCaste live_caste(Caste static_caste, const HwFacts& hw, const LoadSample& load);
+
+// GPU inventory with PCIe link details (currently filled on Linux only).
+std::vector<GpuInfo> detect_gpus();
+
+// Payload bandwidth in bytes/s of a PCIe link, after line encoding.
+uint64_t pcie_link_bandwidth(double speed_gts, int width);
+
+// ---- LLM deployment ----
+//
+// Turns memory sizes into "which model, which quant, how many GPU layers,
+// how much context" before a load is attempted. Estimates follow llama.cpp
+// conventions: quantized weights split evenly across layers, an f16 KV cache
+// held with the layer it belongs to, and a fixed compute buffer.
+
+enum class LlmQuant {
+    Q4_K_M,
+    Q5_K_M,
+    Q8_0,
+    F16,
+};
+
+inline constexpr LlmQuant kAllLlmQuants[] = {LlmQuant::Q4_K_M, LlmQuant::Q5_K_M, LlmQuant::Q8_0, LlmQuant::F16};
+
+// Average bits per weight, including block scales.
+constexpr double llm_quant_bits(LlmQuant q) {
+    switch (q) {
+        case LlmQuant::Q4_K_M: return 4.85;
+        case LlmQuant::Q5_K_M: return 5.69;
+        case LlmQuant::Q8_0: return 8.5;
+        case LlmQuant::F16: return 16.0;
+    }
+    return 16.0;
+}
+
+// "q4_k_m", "q5_k_m", "q8_0", "f16".
+const char* llm_quant_name(LlmQuant q);
+
+struct LlmBudgetOptions {
+    double vram_reserve_fraction = 0.10;              // driver, context, display
+    uint64_t vram_reserve_min = caste_detail::MiB(512);
+    double unified_gpu_fraction = 0.75;               // share of unified memory the GPU may wire
+    double host_reserve_fraction = 0.25;              // OS and other applications
+    uint64_t host_reserve_min = caste_detail::GiB(4);
+
+    // Measured memory bandwidth in bytes/s (0 = unknown); only used for the
+    // decode speed estimate.
+    double gpu_bandwidth_bytes_per_sec = 0.0;
+    double host_bandwidth_bytes_per_sec = 0.0;
+};
+
+struct LlmMemoryBudget {
+    uint64_t gpu_bytes = 0;           // for offloaded layers (0 without a usable GPU)
+    uint64_t host_bytes = 0;          // for layers left on the CPU
+    bool unified = false;             // both come from the same pool
+};
+
+struct LlmQuantFit {
+    LlmQuant quant = LlmQuant::Q4_K_M;
+    uint64_t max_params_gpu = 0;      // fully offloaded
+    uint64_t max_params_total = 0;    // with the rest in host RAM
+};
+
+struct LlmModel {
+    uint64_t params = 0;
+    int layers = 0;
+    int kv_dim = 0;                   // KV heads * head dim (smaller than hidden size with GQA)
+    int max_context = 4096;
+    LlmQuant quant = LlmQuant::Q4_K_M;
+    int kv_bytes_per_value = 2;       // f16 cache; 1 for q8_0
+};
+
+struct LlmPlan {
+    bool fits = false;
+    int gpu_layers = 0;
+    int context_length = 0;
+    uint64_t weight_bytes = 0;
+    uint64_t kv_cache_bytes = 0;
+    uint64_t gpu_bytes_used = 0;
+    uint64_t host_bytes_used = 0;
+    double decode_tokens_per_sec = 0.0;  // 0 unless the bandwidths were given
+};
+
+LlmMemoryBudget llm_memory_budget(const HwFacts& hw, const LlmBudgetOptions& options = {});
+
+// Largest parameter count per quantization, leaving 15% of the budget for
+// KV cache and compute buffers.
+std::array<LlmQuantFit, 4> llm_capacity(const HwFacts& hw, const LlmBudgetOptions& options = {});
+
+// Most GPU layers at the longest context up to model.max_context (halving
+// down to 512 tokens if needed); fits is false when even that does not fit.
+LlmPlan plan_llm(const HwFacts& hw, const LlmModel& model, const LlmBudgetOptions& options = {});
+
+// ---- Thread pools ----
+
+enum class CoreType : uint8_t {
+    Unknown,          // not a hybrid CPU
+    Performance,
+    Efficiency,
+};
+
+// Logical CPUs this process may run on that share a NUMA node and core type.
+struct CpuGroup {
+    int numa_node = 0;
+    CoreType core_type = CoreType::Unknown;
+    int cores = 0;                    // distinct physical cores
+    std::vector<int> cpus;            // logical CPU ids, for pinning
+};
+
+struct CpuTopology {
+    std::vector<CpuGroup> groups;
+    int allowed_threads = 0;          // CPUs in the affinity mask
+    double cpu_quota = 0.0;           // cgroup CPU limit in CPUs; 0 = none
+};
+
+struct ThreadPoolSizes {
+    int compute = 0;                  // CPU-bound work: one per physical core
+    int io = 0;                       // threads that mostly block
+    int background = 0;               // low-priority housekeeping
+};
+
+struct CpuGroupPools {
+    int numa_node = 0;
+    CoreType core_type = CoreType::Unknown;
+    ThreadPoolSizes sizes;
+    std::vector<int> cpus;
+};
+
+struct ThreadPoolPlan {
+    ThreadPoolSizes total;               // one process-wide pool of each kind
+    std::vector<CpuGroupPools> groups;   // per node and core type, for pinned pools
+};
+
+// Affinity mask, NUMA nodes, hybrid core types and cgroup CPU quota (Linux);
+// elsewhere a single group built from detect_hw_facts().
+CpuTopology detect_cpu_topology();
+
+// Compute pools get one thread per physical performance core (efficiency
+// cores only when there are no others), I/O pools twice the usable threads
+// (4..64), background pools prefer efficiency cores. A cgroup quota caps the
+// totals, filling performance cores on the first nodes first. In VMs compute
+// threads are discounted by steal time.
+ThreadPoolPlan recommend_thread_pools(const CpuTopology& topology, const HwFacts& hw);
+ThreadPoolPlan recommend_thread_pools();
+
+// ---- Memory budgets ----
+
+struct MemoryFacts {
+    uint64_t total_bytes = 0;           // physical RAM
+    uint64_t available_bytes = 0;       // free plus reclaimable (MemAvailable); 0 = unknown
+    uint64_t cgroup_limit_bytes = 0;    // container/job limit; 0 = none
+    uint64_t cgroup_usage_bytes = 0;    // charged to that limit so far
+};
+
+// How much of the free memory a process may claim. caste_share is per caste
+// (Mini..Rig): small interactive machines run more applications side by side.
+struct MemoryHeadroomPolicy {
+    double reserve_fraction = 0.10;     // of the limit, kept free for the OS and page cache
+    uint64_t reserve_min = caste_detail::GiB(1);
+    std::array<double, 5> caste_share = {0.25, 0.40, 0.50, 0.60, 0.70};
+    int tenants = 1;                    // processes sharing the claim equally
+    double hot_fraction = 0.50;         // split of the claim between the tiers
+    double warm_fraction = 0.30;
+    double scratch_fraction = 0.20;
+};
+
+struct MemoryBudget {
+    uint64_t limit_bytes = 0;           // RAM or the cgroup limit, whichever is lower
+    uint64_t free_bytes = 0;            // what is free under that limit now
+    uint64_t claimable_bytes = 0;       // this process's share after the reserve
+    uint64_t hot_cache_bytes = 0;       // latency-critical, keep resident
+    uint64_t warm_cache_bytes = 0;      // nice to have, first to shrink
+    uint64_t scratch_bytes = 0;         // transient arenas and buffer pools
+};
+
+// MemAvailable and cgroup v1/v2 limits on Linux, job object limits on
+// Windows; elsewhere total RAM only.
+MemoryFacts detect_memory_facts();
+
+MemoryBudget recommend_memory_budget(const MemoryFacts& mem, Caste caste,
+                                     const MemoryHeadroomPolicy& policy = {});
+MemoryBudget recommend_memory_budget(const MemoryHeadroomPolicy& policy = {});
+
+// ---- Hotplug ----
+
+// Probe groups behind HwFacts, as bits. HwWatcher re-runs only the groups a
+// device event touches.
+enum class HwProbe : uint8_t {
+    Memory = 1u << 0,  // ram_bytes (memory hotplug, balloon drivers)
+    Cpu    = 1u << 1,  // cores, threads, VM and steal (CPU hotplug)
+    Gpu    = 1u << 2,  // GPU kind, VRAM, Arc (PCI hotplug, eGPU)
+};
+
+constexpr uint8_t kAllHwProbes = 0x7;
+constexpr int kHwPollIntervalMs = 5000; // HwWatcher::poll(-1) without device events
+
+// Re-runs the probes in `probes` (HwProbe bits) and updates only their fields.
+void refresh_hw_facts(HwFacts& hw, uint8_t probes);
+// True where each probe group runs on its own (Linux). Elsewhere
+// refresh_hw_facts() runs full detection and keeps the requested fields.
+bool hw_probes_split();
+
+struct HwChange {
+    Caste previous = Caste::Mini;
+    CasteResult result;
+    HwFacts facts;
+    uint8_t probes = 0;  // the probes that ran
+};
+
+// Hardware change notification. Like PowerMonitor nothing runs in the
+// background: call poll() from your loop or when fd() becomes readable.
+// On Linux, poll() waits on kernel uevents (netlink) and re-runs the probes
+// for the subsystems that changed; RAM is re-read on every poll because
+// balloon drivers change it without an event. Elsewhere, or when uevents are
+// unavailable (some containers), every poll() re-runs all probes.
+// Callbacks fire when the caste changes.
+class HwWatcher {
+public:
+    using Callback = std::function<void(const HwChange&)>;
+    using Source = std::function<void(HwFacts&, uint8_t)>;
+
+    explicit HwWatcher(const CastePolicy& policy = kDefaultCastePolicy, Source source = refresh_hw_facts);
+    ~HwWatcher();
+    HwWatcher(const HwWatcher&) = delete;
+    HwWatcher& operator=(const HwWatcher&) = delete;
+
+    void on_change(Callback cb);
+    // Waits up to timeout_ms for device events (-1 = forever), then refreshes.
+    // Without an event fd, -1 sleeps kHwPollIntervalMs instead.
+    // True if the caste changed (callbacks have been invoked).
+    bool poll(int timeout_ms = 0);
+    // Re-runs the given probes now; same return value as poll().
+    bool refresh(uint8_t probes);
+
+    int fd() const { return fd_; }  // readable on device events; -1 if none
+    const HwFacts& facts() const { return facts_; }
+    const CasteResult& result() const { return result_; }
+
+private:
+    CastePolicy policy_;
+    Source source_;
+    std::vector<Callback> callbacks_;
+    HwFacts facts_;
+    CasteResult result_;
+    int fd_ = -1;
+};
+
+// ---- casted (local detection daemon) ----
+
+// casted runs detection once, refreshes it on hotplug, and answers over a
+// Unix domain socket. A request is kCastedRequestSize bytes ("CST", version,
+// opcode, 3 zero bytes); the reply is one kCastedRecordSize record, all
+// integers little-endian:
+//   0  "CST" version     4  u16 record size   6  u8 GpuKind   7  u8 HwFlag bits | 0x10 Apple Silicon
+//   8  u64 ram_bytes    16  u64 vram_bytes   24  i32 physical_cores
+//  28  i32 logical_threads  32  u8 cpu_steal_percent, 3 zero bytes
+//  36  u32 generation (incremented whenever the facts change)
+constexpr uint8_t kCastedVersion = 1;
+constexpr uint8_t kCastedOpFacts = 1;
+constexpr size_t kCastedRequestSize = 8;
+constexpr size_t kCastedRecordSize = 40;
+constexpr const char* kCastedSocketPath = "/run/casted.sock"; // CASTE_SOCKET overrides
+
+void encode_casted_record(const HwFacts& hw, uint32_t generation, uint8_t out[kCastedRecordSize]);
+bool decode_casted_record(const uint8_t* in, size_t size, HwFacts& hw, uint32_t* generation = nullptr);
+
+// Asks the daemon (nullptr: $CASTE_SOCKET, else kCastedSocketPath). False
+// when there is no daemon or it does not answer within 200ms.
+bool query_casted(HwFacts& hw, const char* socket_path = nullptr);
+
+// query_casted(), falling back to detect_hw_facts() in-process.
+HwFacts cached_hw_facts();
+
+// ---- Shared-memory snapshot ----
+
+// For hot loops where even a casted round-trip is too slow. A publisher
+// (casted, or your own process) keeps HwFacts and the CasteResult in a small
+// shared-memory segment updated under a seqlock; readers map it read-only
+// once and then take consistent snapshots with plain loads, no syscalls.
+// The segment is only shared between builds with the same struct layout;
+// others see it as absent. There is one publisher per name: a second one is
+// not ok() while the first is alive. POSIX shm only; ok() is false on Windows.
+constexpr const char* kCasteShmName = "/caste"; // CASTE_SHM overrides
+
+struct CasteSnapshot {
+    HwFacts facts;
+    CasteResult result;
+    uint32_t version = 0;  // increments with every publish
+};
+
+class CasteShmPublisher {
+public:
+    explicit CasteShmPublisher(const char* name = nullptr);
+    ~CasteShmPublisher(); // retires and unlinks the segment; mapped readers' read() then fails
+    CasteShmPublisher(const CasteShmPublisher&) = delete;
+    CasteShmPublisher& operator=(const CasteShmPublisher&) = delete;
+
+    bool ok() const { return segment_ != nullptr; }
+    void publish(const HwFacts& hw, const CasteResult& result);
+
+private:
+    void* segment_ = nullptr;
+    std::string name_;
+};
+
+class CasteShmReader {
+public:
+    explicit CasteShmReader(const char* name = nullptr);
+    ~CasteShmReader();
+    CasteShmReader(const CasteShmReader&) = delete;
+    CasteShmReader& operator=(const CasteShmReader&) = delete;
+
+    bool ok() const { return segment_ != nullptr; }
+    // False if the segment is not mapped, nothing has been published yet, or
+    // its publisher has shut down (construct a new reader to find the next one).
+    bool read(CasteSnapshot& out) const;
+
+private:
+    const void* segment_ = nullptr;
+};
+
+// ---- Build parallelism ----
+
+// Per-job peak memory. Defaults fit optimized C++ translation units and
+// linking large binaries with debug info (ld.bfd/gold; lld and mold need less).
+struct BuildJobOptions {
+    uint64_t compile_job_bytes = caste_detail::GiB(1) + caste_detail::MiB(512);
+    uint64_t link_job_bytes = caste_detail::GiB(4);
+    MemoryHeadroomPolicy headroom;    // only the reserve is used
+};
+
+struct BuildJobs {
+    int compile = 1;                  // make -j, ninja's default pool, cmake --parallel
+    int link = 1;                     // ninja job pool for link steps
+};
+
+// Compile jobs: usable CPUs (affinity mask, cgroup quota), but no more than
+// fit in free memory after the reserve and one link job. Link jobs: as many
+// link_job_bytes as fit beside the compile jobs, since Ninja runs both pools
+// at once; never more than compile jobs. Both are at least 1.
+BuildJobs recommend_build_jobs(const CpuTopology& topology, const MemoryFacts& mem,
+                               const BuildJobOptions& options = {});
+BuildJobs recommend_build_jobs(const BuildJobOptions& options = {});
+
+// ---- Environment export ----
+
+// Shell syntax for `caste --export`.
+enum class ExportFormat {
+    Sh,          // export NAME='value'
+    Fish,        // set -gx NAME 'value'
+    PowerShell,  // $env:NAME = 'value'
+    Dotenv,      // NAME=value, double-quoted when not a plain word
+};
+
+// "sh", "fish", "powershell" or "dotenv"; false for anything else.
+bool parse_export_format(const std::string& name, ExportFormat& out);
+
+struct ExportVariable {
+    const char* name;
+    std::string value;
+};
+
+// CASTE, CASTE_THREADS, CASTE_CORES, CASTE_RAM_BYTES, CASTE_VRAM_BYTES,
+// CASTE_ISA_LEVEL, CASTE_COMPILE_JOBS, CASTE_LINK_JOBS, OMP_NUM_THREADS and
+// MALLOC_ARENA_MAX, in that order.
+std::vector<ExportVariable> export_variables(const HwFacts& hw, const CasteResult& result,
+                                             const ThreadPoolSizes& pools, const BuildJobs& jobs);
+
+// One line per variable, values quoted for the format.
+std::string format_exports(const std::vector<ExportVariable>& vars, ExportFormat format);
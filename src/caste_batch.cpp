@@ -0,0 +1,163 @@
+#include "caste.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// Records per block: columns are staged into fixed stack arrays (null
+// columns become zeros) so the kernel loop sees dense, non-null data.
+constexpr size_t kBlock = 256;
+
+// x86-64 baseline (SSE2) has no 64-bit lane compare; build SSE4.2 and AVX2
+// clones of the kernel and let the loader pick one. That is an ifunc, which
+// glibc's loader resolves and musl's does not. The kernel loop vectorizes at
+// -O3 (CMakeLists.txt sets it for this file).
+#if defined(__x86_64__) && defined(__ELF__) && defined(__GLIBC__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define CASTE_KERNEL_CLONES __attribute__((target_clones("avx2", "sse4.2", "default")))
+#endif
+#endif
+#ifndef CASTE_KERNEL_CLONES
+#define CASTE_KERNEL_CLONES
+#endif
+
+constexpr uint64_t kMaxCpuThreshold = static_cast<uint64_t>(INT32_MAX);
+
+static_assert(static_cast<int>(HwFlag::DiscreteGpu) == 1 << 0 &&
+              static_cast<int>(HwFlag::UnifiedMemory) == 1 << 1 &&
+              static_cast<int>(HwFlag::IntelArc) == 1 << 2 &&
+              static_cast<int>(HwFlag::VirtualMachine) == 1 << 3,
+              "classify_block() reads the flag bits by position");
+
+struct Thresholds {
+    uint64_t vram[5];
+    uint64_t unified[5];
+    uint64_t ram_cap[5];
+    int64_t centi_cores[5];  // cpu_cores_min * 100
+    int64_t threads[5];
+    uint64_t ram_floor;
+    uint64_t arc_bump_ram;
+};
+
+// Number of thresholds t[1..4] the value meets. Equals caste_from_table()
+// for non-decreasing tables, without the early-exit branches.
+template <typename T>
+static inline int64_t table_rank(const T t[5], T v) {
+    return static_cast<int64_t>(v >= t[1]) + static_cast<int64_t>(v >= t[2]) +
+           static_cast<int64_t>(v >= t[3]) + static_cast<int64_t>(v >= t[4]);
+}
+
+static inline int64_t min64(int64_t a, int64_t b) { return a < b ? a : b; }
+static inline int64_t max64(int64_t a, int64_t b) { return a > b ? a : b; }
+
+// Straight-line selects over 64-bit lanes so compilers emit SIMD
+// compares/blends (SSE4/AVX2/AVX-512/NEON) at -O3. Mirrors classify_caste()
+// step by step; see the comments there. Cores are kept in hundredths so the
+// steal discount needs no division: floor(c * (100 - s) / 100) >= n is
+// c * (100 - s) >= n * 100.
+CASTE_KERNEL_CLONES
+static void classify_block(const Thresholds& thresholds, size_t n,
+                           const uint64_t* __restrict ram_col, const uint64_t* __restrict vram_col,
+                           const int64_t* __restrict cores_col, const int64_t* __restrict threads_col,
+                           const int64_t* __restrict flags_col, const int64_t* __restrict steal_col,
+                           uint8_t* __restrict out) {
+    const Thresholds t = thresholds; // local copy: out (uint8_t) may alias anything
+    for (size_t i = 0; i < n; i++) {
+        const uint64_t ram = ram_col[i];
+        const uint64_t vram = vram_col[i];
+        const int64_t cores = cores_col[i];
+        const int64_t threads = threads_col[i];
+        const int64_t f = flags_col[i];
+        const int64_t steal = min64(steal_col[i], 100);
+
+        // 0/1 lanes from the HwFlag bits (shifts keep the masks in one width).
+        const int64_t discrete = f & 1;
+        const int64_t unified = (f >> 1) & 1 & (discrete ^ 1);
+        const int64_t arc = (f >> 2) & 1 & (discrete ^ 1);
+        const int64_t vm = (f >> 3) & 1;
+
+        // 1) Base caste (integrated => User), 2) Arc-class iGPU bump
+        const int64_t base_discrete = table_rank(t.vram, vram);
+        const int64_t base_unified = max64(table_rank(t.unified, ram), 1);
+        int64_t base = discrete ? base_discrete : (unified ? base_unified : 1);
+        base = (arc & (ram >= t.arc_bump_ram)) ? max64(base, 2) : base;
+
+        // 3) RAM clamp
+        int64_t capped = min64(base, table_rank(t.ram_cap, ram));
+
+        // 4) CPU clamp, with the VM vCPU discount (in hundredths of a core)
+        const int64_t smt_exposed = (cores > 0) & (cores < threads);
+        const int64_t vcpus = threads > 0 ? threads : cores;
+        int64_t vm_centi = (smt_exposed ? cores : vcpus / 2) * (100 - steal);
+        const int64_t has_vcpus = (threads > 0) | (cores > 0); // vcpus > 0
+        vm_centi = ((vm_centi < 100) & has_vcpus) ? 100 : vm_centi;
+        const int64_t centi = vm ? vm_centi : cores * 100;
+
+        const int64_t cap_by_cores = table_rank(t.centi_cores, centi);
+        const int64_t cap_by_threads = table_rank(t.threads, threads);
+        const int64_t cap_cpu = centi >= 100 ? cap_by_cores : (threads > 0 ? cap_by_threads : 4);
+        capped = min64(capped, cap_cpu);
+
+        // 0) + 5) RAM floor: Mini below it, never below User above it
+        capped = max64(capped, 1);
+        out[i] = static_cast<uint8_t>(ram >= t.ram_floor ? capped : 0);
+    }
+}
+
+static void stage(uint64_t* dst, const uint64_t* src, size_t offset, size_t n) {
+    if (src) std::memcpy(dst, src + offset, n * sizeof(uint64_t));
+    else std::memset(dst, 0, n * sizeof(uint64_t));
+}
+
+// Narrow columns are widened so the kernel works in a single lane width.
+template <typename T>
+static void widen(int64_t* dst, const T* src, size_t offset, size_t n) {
+    if (!src) {
+        std::memset(dst, 0, n * sizeof(int64_t));
+        return;
+    }
+    for (size_t i = 0; i < n; i++) dst[i] = src[offset + i];
+}
+
+} // namespace
+
+void classify_many(const HwFactsColumns& in, uint8_t* out, const CastePolicy& policy) {
+    bool fast = policy_is_monotonic(policy);
+    for (int k = 0; k < 5; k++) {
+        // Keeps n * 100 and the core/thread compares within int64.
+        fast = fast && policy.cpu_cores_min[k] <= kMaxCpuThreshold &&
+               policy.cpu_threads_min[k] <= kMaxCpuThreshold;
+    }
+    if (!fast) {
+        for (size_t i = 0; i < in.count; i++) {
+            out[i] = static_cast<uint8_t>(classify_caste(hw_facts_from_columns(in, i), policy).caste);
+        }
+        return;
+    }
+
+    Thresholds t{};
+    for (int k = 0; k < 5; k++) {
+        t.vram[k] = policy.vram_min[k];
+        t.unified[k] = policy.unified_ram_min[k];
+        t.ram_cap[k] = policy.ram_cap_min[k];
+        t.centi_cores[k] = static_cast<int64_t>(policy.cpu_cores_min[k]) * 100;
+        t.threads[k] = static_cast<int64_t>(policy.cpu_threads_min[k]);
+    }
+    t.ram_floor = policy.ram_floor;
+    t.arc_bump_ram = policy.arc_bump_ram;
+
+    uint64_t vram[kBlock];
+    int64_t cores[kBlock], threads[kBlock], flags[kBlock], steal[kBlock];
+
+    for (size_t off = 0; off < in.count; off += kBlock) {
+        const size_t n = (in.count - off < kBlock) ? in.count - off : kBlock;
+        stage(vram, in.vram_bytes, off, n);
+        widen(cores, in.physical_cores, off, n);
+        widen(threads, in.logical_threads, off, n);
+        widen(flags, in.flags, off, n);
+        widen(steal, in.cpu_steal_percent, off, n);
+        classify_block(t, n, in.ram_bytes + off, vram, cores, threads, flags, steal, out + off);
+    }
+}
@@ -1,12 +1,215 @@
 #include "caste.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Minimal JSON writer for --json: appends to one string, no DOM and no
+// dependencies. Keys and values are written in call order.
+class JsonWriter {
+public:
+    void begin_object(const char* key = nullptr) { open(key, '{'); }
+    void end_object() { close('}'); }
+    void begin_array(const char* key = nullptr) { open(key, '['); }
+    void end_array() { close(']'); }
+
+    void value(const char* key, const char* v) {
+        sep(key);
+        quote(v);
+    }
+    void value(const char* key, const std::string& v) { value(key, v.c_str()); }
+    void value(const char* key, bool v) {
+        sep(key);
+        out_ += v ? "true" : "false";
+    }
+    void value(const char* key, uint64_t v) {
+        sep(key);
+        out_ += std::to_string(v);
+    }
+    void value(const char* key, int v) {
+        sep(key);
+        out_ += std::to_string(v);
+    }
+    void value(const char* key, double v) {
+        sep(key);
+        if (!std::isfinite(v)) {
+            out_ += "null";
+            return;
+        }
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.6g", v);
+        out_ += buf;
+    }
+
+    const std::string& str() const { return out_; }
+
+private:
+    void open(const char* key, char c) {
+        sep(key);
+        out_ += c;
+        first_.push_back(true);
+    }
+
+    void close(char c) {
+        out_ += c;
+        first_.pop_back();
+    }
+
+    void sep(const char* key) {
+        if (!first_.empty()) {
+            if (!first_.back()) out_ += ',';
+            first_.back() = false;
+        }
+        if (key) {
+            quote(key);
+            out_ += ':';
+        }
+    }
+
+    void quote(const char* s) {
+        out_ += '"';
+        for (; *s; ++s) {
+            const unsigned char c = static_cast<unsigned char>(*s);
+            switch (c) {
+                case '"': out_ += "\\\""; break;
+                case '\\': out_ += "\\\\"; break;
+                case '\n': out_ += "\\n"; break;
+                case '\r': out_ += "\\r"; break;
+                case '\t': out_ += "\\t"; break;
+                default:
+                    if (c < 0x20) {
+                        char buf[8];
+                        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        out_ += buf;
+                    } else {
+                        out_ += static_cast<char>(c);
+                    }
+            }
+        }
+        out_ += '"';
+    }
+
+    std::string out_;
+    std::vector<bool> first_;
+};
+
+const char* gpu_kind_name(GpuKind k) {
+    switch (k) {
+        case GpuKind::None: return "none";
+        case GpuKind::Integrated: return "integrated";
+        case GpuKind::Unified: return "unified";
+        case GpuKind::Discrete: return "discrete";
+    }
+    return "none";
+}
+
+void write_facts(JsonWriter& j, const HwFacts& hw) {
+    j.begin_object("facts");
+    j.value("ram_bytes", hw.ram_bytes);
+    j.value("physical_cores", hw.physical_cores);
+    j.value("logical_threads", hw.logical_threads);
+    j.value("gpu_kind", gpu_kind_name(hw.gpu_kind));
+    j.value("vram_bytes", hw.vram_bytes);
+    j.value("has_discrete_gpu", hw.has_discrete_gpu);
+    j.value("is_apple_silicon", hw.is_apple_silicon);
+    j.value("is_intel_arc", hw.is_intel_arc);
+    j.value("is_virtual_machine", hw.is_virtual_machine);
+    j.value("cpu_steal_percent", static_cast<int>(hw.cpu_steal_percent));
+    j.end_object();
+}
+
+// Caste, rule names, the intermediate castes and the numbers behind them.
+void write_result(JsonWriter& j, const CasteResult& r) {
+    j.value("caste", caste_name(r.caste));
+    j.value("reason", caste_reason_text(r));
+    j.begin_array("reasons");
+    for (CasteRule rule : kAllCasteRules) {
+        if (r.reasons.has(rule)) j.value(nullptr, caste_rule_name(rule));
+    }
+    j.end_array();
+    j.value("base", caste_name(r.base));
+    j.value("ram_cap", caste_name(r.ram_cap));
+    j.value("cpu_cap", caste_name(r.cpu_cap));
+    j.value("effective_cores", r.effective_cores);
+    if (r.reasons.has(CasteRule::VirtualCpus)) {
+        j.value("vcpus", r.vcpus);
+        j.value("steal_percent", r.steal_percent);
+    }
+    j.value("score", r.score);
+    j.value("memory_score", r.memory_score);
+    j.value("cpu_score", r.cpu_score);
+    j.value("gpu_score", r.gpu_score);
+}
+
+// Wall time per probe, in microseconds, for "timings_us".
+struct ProbeTimings {
+    std::vector<std::pair<const char*, double>> entries;
+
+    template <typename F>
+    void time(const char* name, F&& f) {
+        const auto t0 = std::chrono::steady_clock::now();
+        f();
+        const std::chrono::duration<double, std::micro> us = std::chrono::steady_clock::now() - t0;
+        entries.emplace_back(name, us.count());
+    }
+
+    void write(JsonWriter& j) const {
+        j.begin_object("timings_us");
+        for (const auto& [name, us] : entries) j.value(name, us);
+        j.end_object();
+    }
+};
+
+// cached_hw_facts(), split so each probe group gets its own timing when
+// there is no daemon and the platform has separate probes; otherwise one
+// "detect" timing.
+HwFacts timed_hw_facts(ProbeTimings& timings, const char*& source) {
+    HwFacts hw;
+    bool cached = false;
+    timings.time("casted", [&] { cached = query_casted(hw); });
+    if (cached) {
+        source = "casted";
+        return hw;
+    }
+    source = "probe";
+    if (!hw_probes_split()) {
+        timings.time("detect", [&] { hw = detect_hw_facts(); });
+        return hw;
+    }
+    hw = HwFacts{};
+    timings.time("memory", [&] { refresh_hw_facts(hw, static_cast<uint8_t>(HwProbe::Memory)); });
+    timings.time("cpu", [&] { refresh_hw_facts(hw, static_cast<uint8_t>(HwProbe::Cpu)); });
+    timings.time("gpu", [&] { refresh_hw_facts(hw, static_cast<uint8_t>(HwProbe::Gpu)); });
+    return hw;
+}
+
+} // namespace
 
 int main(int argc, char** argv) {
     bool want_reason = false;
     bool want_help = false;
     bool want_version = false;
+    bool want_gpus = false;
+    bool want_power_aware = false;
+    bool want_sustained = false;
+    bool want_live = false;
+    bool want_watch = false;
+    bool want_json = false;
+    bool want_jobs = false;
+    bool want_export = false;
+    std::string export_format;
+    std::string jobs_kind;             // "", "compile" or "link"
+    std::string compile_job_mem;
+    std::string link_job_mem;
+    std::string policy_path;
+    std::string workload_arg;
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--reason") {
@@ -15,13 +218,66 @@ int main(int argc, char** argv) {
             want_help = true;
         } else if (arg == "--version") {
             want_version = true;
+        } else if (arg == "--gpus") {
+            want_gpus = true;
+        } else if (arg == "--power-aware") {
+            want_power_aware = true;
+        } else if (arg == "--sustained") {
+            want_sustained = true;
+        } else if (arg == "--live") {
+            want_live = true;
+        } else if (arg == "--watch") {
+            want_watch = true;
+        } else if (arg == "--json") {
+            want_json = true;
+        } else if (arg == "--policy" && i + 1 < argc) {
+            policy_path = argv[++i];
+        } else if (arg.rfind("--policy=", 0) == 0) {
+            policy_path = arg.substr(9);
+        } else if (arg == "--workload" && i + 1 < argc) {
+            workload_arg = argv[++i];
+        } else if (arg.rfind("--workload=", 0) == 0) {
+            workload_arg = arg.substr(11);
+        } else if (arg == "--export" || arg.rfind("--export=", 0) == 0) {
+            want_export = true;
+            if (arg.size() > 8) {
+                export_format = arg.substr(9);
+            } else if (i + 1 < argc) {
+                export_format = argv[++i];
+            }
+        } else if (arg == "--jobs") {
+            want_jobs = true;
+            if (i + 1 < argc && (std::string(argv[i + 1]) == "compile" || std::string(argv[i + 1]) == "link")) {
+                jobs_kind = argv[++i];
+            }
+        } else if (arg == "--compile-job-mem" && i + 1 < argc) {
+            compile_job_mem = argv[++i];
+        } else if (arg.rfind("--compile-job-mem=", 0) == 0) {
+            compile_job_mem = arg.substr(18);
+        } else if (arg == "--link-job-mem" && i + 1 < argc) {
+            link_job_mem = argv[++i];
+        } else if (arg.rfind("--link-job-mem=", 0) == 0) {
+            link_job_mem = arg.substr(15);
         }
     }
 
     if (want_help) {
-        std::cout << "Usage: caste [--reason]\n"
+        std::cout << "Usage: caste [--reason] [--policy FILE] [--workload NAME] [--power-aware] [--sustained] [--live] [--watch] [--gpus] [--json]\n"
+                     "       caste --export sh|fish|powershell|dotenv [--policy FILE] [--compile-job-mem SIZE] [--link-job-mem SIZE]\n"
+                     "       caste --jobs [compile|link] [--compile-job-mem SIZE] [--link-job-mem SIZE] [--json]\n"
                      "  Prints a single-word hardware class.\n"
                      "  --reason  Include a short explanation.\n"
+                     "  --policy FILE Classify with thresholds from FILE.\n"
+                     "  --workload NAME Classify for llm_inference, video_transcode, compile or training.\n"
+                     "  --power-aware Demote the class on battery or low-power profile.\n"
+                     "  --sustained Demote the class for thermal/power-limited machines.\n"
+                     "  --live    Demote by current load (PSI/loadavg) and print headroom.\n"
+                     "  --watch   Print the class, then a line each time hardware changes it.\n"
+                     "  --gpus    List GPUs with PCIe link and bandwidth estimate.\n"
+                     "  --export FORMAT Print CASTE, CASTE_THREADS, OMP_NUM_THREADS, ... as shell variables.\n"
+                     "  --jobs    Recommend compile and link job counts from CPUs and free memory.\n"
+                     "  --compile-job-mem SIZE, --link-job-mem SIZE Peak memory per job (1.5GiB, 4GiB).\n"
+                     "  --json    Print JSON with facts and probe timings (NDJSON with --watch).\n"
                      "  --version Show version.\n"
                      "  -h, --help Show this help.\n";
         return 0;
@@ -32,15 +288,239 @@ int main(int argc, char** argv) {
         return 0;
     }
 
+    CastePolicy policy = kDefaultCastePolicy;
+    if (!policy_path.empty()) {
+        std::string error;
+        if (!load_policy_file(policy_path, policy, &error)) {
+            std::cerr << "caste: " << policy_path << ": " << error << "\n";
+            return 1;
+        }
+    }
+
+    BuildJobOptions job_options;
+    for (auto [text, bytes] : {std::pair{&compile_job_mem, &job_options.compile_job_bytes},
+                               std::pair{&link_job_mem, &job_options.link_job_bytes}}) {
+        if (!text->empty() && !parse_size_bytes(*text, *bytes)) {
+            std::cerr << "caste: invalid size '" << *text << "'\n";
+            return 1;
+        }
+    }
+
+    if (want_export) {
+        // Printing the caste word instead would have `eval` run it as a command.
+        ExportFormat format;
+        if (export_format.empty()) {
+            std::cerr << "caste: --export needs a format: sh, fish, powershell or dotenv\n";
+            return 1;
+        }
+        if (!parse_export_format(export_format, format)) {
+            std::cerr << "caste: unknown export format '" << export_format << "'\n";
+            return 1;
+        }
+        const HwFacts hw = cached_hw_facts();
+        const CasteResult r = classify_caste(hw, policy);
+        const ThreadPoolSizes pools = recommend_thread_pools(detect_cpu_topology(), hw).total;
+        const BuildJobs jobs = recommend_build_jobs(job_options);
+        std::cout << format_exports(export_variables(hw, r, pools, jobs), format);
+        return 0;
+    }
+
+    if (want_jobs) {
+        const BuildJobs jobs = recommend_build_jobs(job_options);
+        if (want_json) {
+            JsonWriter j;
+            j.begin_object();
+            j.value("compile", jobs.compile);
+            j.value("link", jobs.link);
+            j.value("compile_job_bytes", job_options.compile_job_bytes);
+            j.value("link_job_bytes", job_options.link_job_bytes);
+            j.end_object();
+            std::cout << j.str() << "\n";
+        } else if (jobs_kind == "compile") {
+            std::cout << jobs.compile << "\n";
+        } else if (jobs_kind == "link") {
+            std::cout << jobs.link << "\n";
+        } else {
+            std::cout << "compile=" << jobs.compile << " link=" << jobs.link << "\n";
+        }
+        return 0;
+    }
+
+    if (!workload_arg.empty()) {
+        Workload w;
+        if (!parse_workload(workload_arg, w)) {
+            std::cerr << "caste: unknown workload '" << workload_arg << "'\n";
+            return 1;
+        }
+        // Workload profiles have no power, thermal, load or hotplug variants.
+        for (auto [flag, name] : {std::pair{want_power_aware, "--power-aware"}, std::pair{want_sustained, "--sustained"},
+                                  std::pair{want_live, "--live"}, std::pair{want_watch, "--watch"}}) {
+            if (flag) {
+                std::cerr << "caste: --workload cannot be combined with " << name << "\n";
+                return 1;
+            }
+        }
+        WorkloadProfile profile = workload_profile(w);
+        if (!policy_path.empty()) profile.policy = policy;
+        if (want_json) {
+            ProbeTimings timings;
+            const char* source = nullptr;
+            const HwFacts hw = timed_hw_facts(timings, source);
+            CasteResult r;
+            timings.time("classify", [&] { r = classify_workload(hw, profile); });
+            JsonWriter j;
+            j.begin_object();
+            j.value("workload", workload_name(w));
+            write_result(j, r);
+            j.value("source", source);
+            write_facts(j, hw);
+            timings.write(j);
+            j.end_object();
+            std::cout << j.str() << "\n";
+            return 0;
+        }
+        CasteResult r = classify_workload(cached_hw_facts(), profile);
+        std::cout << caste_name(r.caste);
+        if (want_reason) {
+            std::string reason = caste_reason_text(r);
+            if (!reason.empty()) std::cout << ": " << reason;
+        }
+        std::cout << "\n";
+        return 0;
+    }
+
+    if (want_gpus) {
+        JsonWriter j;
+        j.begin_array();
+        for (const GpuInfo& g : detect_gpus()) {
+            if (want_json) {
+                j.begin_object();
+                j.value("vendor_id", static_cast<int>(g.vendor_id));
+                j.value("device_id", static_cast<int>(g.device_id));
+                j.value("kind", gpu_kind_name(g.kind));
+                j.value("vram_bytes", g.vram_bytes);
+                j.value("is_intel_arc", g.is_intel_arc);
+                j.value("pcie_current_speed_gts", g.pcie_current_speed_gts);
+                j.value("pcie_current_width", g.pcie_current_width);
+                j.value("pcie_max_speed_gts", g.pcie_max_speed_gts);
+                j.value("pcie_max_width", g.pcie_max_width);
+                j.value("host_to_device_bytes_per_sec", g.host_to_device_bytes_per_sec);
+                j.end_object();
+                continue;
+            }
+            char line[256];
+            std::snprintf(line, sizeof(line),
+                          "%04x:%04x %s vram=%.1fGiB pcie=%.1fGT/s x%d (max %.1fGT/s x%d) h2d=%.1fGB/s\n",
+                          g.vendor_id, g.device_id,
+                          g.kind == GpuKind::Discrete ? "discrete" : "integrated",
+                          g.vram_bytes / (1024.0 * 1024.0 * 1024.0),
+                          g.pcie_current_speed_gts, g.pcie_current_width,
+                          g.pcie_max_speed_gts, g.pcie_max_width,
+                          g.host_to_device_bytes_per_sec / 1e9);
+            std::cout << line;
+        }
+        j.end_array();
+        if (want_json) std::cout << j.str() << "\n";
+        return 0;
+    }
+
+    if (want_watch) {
+        // --json: NDJSON, one object per line.
+        auto print = [&](const CasteResult& r, const HwFacts& hw, uint8_t probes) {
+            if (want_json) {
+                JsonWriter j;
+                j.begin_object();
+                write_result(j, r);
+                write_facts(j, hw);
+                j.begin_array("probes");
+                if (probes & static_cast<uint8_t>(HwProbe::Memory)) j.value(nullptr, "memory");
+                if (probes & static_cast<uint8_t>(HwProbe::Cpu)) j.value(nullptr, "cpu");
+                if (probes & static_cast<uint8_t>(HwProbe::Gpu)) j.value(nullptr, "gpu");
+                j.end_array();
+                j.end_object();
+                std::cout << j.str() << std::endl;
+                return;
+            }
+            std::cout << caste_name(r.caste);
+            if (want_reason) {
+                std::string reason = caste_reason_text(r);
+                if (!reason.empty()) std::cout << ": " << reason;
+            }
+            std::cout << std::endl;
+        };
+        HwWatcher watcher(policy);
+        watcher.on_change([&](const HwChange& change) { print(change.result, change.facts, change.probes); });
+        print(watcher.result(), watcher.facts(), kAllHwProbes);
+        for (;;) watcher.poll(kHwPollIntervalMs); // RAM has no event; re-read it every few seconds
+    }
+
+    ProbeTimings timings;
+    const char* source = nullptr;
+    HwFacts hw = want_json ? timed_hw_facts(timings, source) : cached_hw_facts();
+
+    if (want_live) {
+        LoadSample load;
+        timings.time("load", [&] { load = sample_load(); });
+        LiveCaste live = live_caste(classify_caste(hw, policy).caste, hw, load);
+        if (want_json) {
+            JsonWriter j;
+            j.begin_object();
+            j.value("caste", caste_name(live.caste));
+            j.value("cpu_headroom", static_cast<double>(live.cpu_headroom));
+            j.value("memory_headroom", static_cast<double>(live.memory_headroom));
+            j.value("io_headroom", static_cast<double>(live.io_headroom));
+            j.value("source", source);
+            write_facts(j, hw);
+            timings.write(j);
+            j.end_object();
+            std::cout << j.str() << "\n";
+            return 0;
+        }
+        char line[128];
+        std::snprintf(line, sizeof(line), "%s cpu=%.2f memory=%.2f io=%.2f\n",
+                      caste_name(live.caste), live.cpu_headroom, live.memory_headroom, live.io_headroom);
+        std::cout << line;
+        return 0;
+    }
+
+    // With several adjustments requested, the lowest class wins.
+    CasteResult result;
+    timings.time("classify", [&] { result = classify_caste(hw, policy); });
+    auto keep_lower = [&](CasteResult r) {
+        if (static_cast<int>(r.caste) <= static_cast<int>(result.caste)) result = std::move(r);
+    };
+    if (want_power_aware) {
+        PowerState ps;
+        timings.time("power", [&] { ps = detect_power_state(); });
+        keep_lower(classify_caste_power_aware(hw, ps, policy));
+    }
+    if (want_sustained) {
+        ThermalState thermal;
+        timings.time("thermal", [&] { thermal = detect_thermal_state(); });
+        keep_lower(classify_caste_sustained(hw, thermal, policy));
+    }
+
+    if (want_json) {
+        JsonWriter j;
+        j.begin_object();
+        write_result(j, result);
+        j.value("source", source);
+        write_facts(j, hw);
+        timings.write(j);
+        j.end_object();
+        std::cout << j.str() << "\n";
+        return 0;
+    }
+
     if (!want_reason) {
-        std::cout << detect_caste_word() << "\n";
+        std::cout << caste_name(result.caste) << "\n";
         return 0;
     }
 
-    CasteResult result = detect_caste();
     std::cout << caste_name(result.caste);
-    if (!result.reason.empty()) {
-        std::cout << ": " << result.reason;
+    std::string reason = caste_reason_text(result);
+    if (!reason.empty()) {
+        std::cout << ": " << reason;
     }
     std::cout << "\n";
     return 0;
@@ -0,0 +1,179 @@
+#include "caste.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0 // macOS: SO_NOSIGPIPE is set on the socket instead
+#endif
+
+namespace {
+
+constexpr int kQueryTimeoutMs = 200;
+constexpr uint8_t kAppleSiliconBit = 0x10; // next to the HwFlag bits
+
+void put_u16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+void put_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+void put_u64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+uint16_t get_u16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+    return v;
+}
+
+uint64_t get_u64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+bool has_magic(const uint8_t* p) {
+    return p[0] == 'C' && p[1] == 'S' && p[2] == 'T' && p[3] == kCastedVersion;
+}
+
+#if !defined(_WIN32)
+using Deadline = std::chrono::steady_clock::time_point;
+
+// Waits for events on fd until the deadline; false on timeout or error.
+bool wait_for(int fd, short events, Deadline deadline) {
+    for (;;) {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) return false;
+        pollfd pfd{fd, events, 0};
+        const int ready = ::poll(&pfd, 1, static_cast<int>(left));
+        if (ready > 0) return true;
+        if (ready == 0 || errno != EINTR) return false;
+    }
+}
+
+// Connects without blocking past the deadline. Linux fails a nonblocking
+// AF_UNIX connect with EAGAIN when the daemon's backlog is full; that counts
+// as no answer.
+bool connect_by(int fd, const sockaddr_un& addr, Deadline deadline) {
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) return true;
+    if (errno != EINPROGRESS && errno != EINTR) return false;
+    if (!wait_for(fd, POLLOUT, deadline)) return false;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    return ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+}
+
+// Reads or writes all of buf before the deadline.
+bool transfer(int fd, uint8_t* buf, size_t size, bool write, Deadline deadline) {
+    size_t done = 0;
+    while (done < size) {
+        if (!wait_for(fd, write ? POLLOUT : POLLIN, deadline)) return false;
+        const ssize_t n = write ? ::send(fd, buf + done, size - done, MSG_NOSIGNAL)
+                                : ::recv(fd, buf + done, size - done, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+void encode_casted_record(const HwFacts& hw, uint32_t generation, uint8_t out[kCastedRecordSize]) {
+    std::memset(out, 0, kCastedRecordSize);
+    out[0] = 'C';
+    out[1] = 'S';
+    out[2] = 'T';
+    out[3] = kCastedVersion;
+    put_u16(out + 4, static_cast<uint16_t>(kCastedRecordSize));
+    out[6] = static_cast<uint8_t>(hw.gpu_kind);
+    out[7] = static_cast<uint8_t>(hw_flags(hw) | (hw.is_apple_silicon ? kAppleSiliconBit : 0));
+    put_u64(out + 8, hw.ram_bytes);
+    put_u64(out + 16, hw.vram_bytes);
+    put_u32(out + 24, static_cast<uint32_t>(hw.physical_cores));
+    put_u32(out + 28, static_cast<uint32_t>(hw.logical_threads));
+    out[32] = hw.cpu_steal_percent;
+    put_u32(out + 36, generation);
+}
+
+bool decode_casted_record(const uint8_t* in, size_t size, HwFacts& hw, uint32_t* generation) {
+    if (size < kCastedRecordSize || !has_magic(in) || get_u16(in + 4) != kCastedRecordSize) return false;
+    if (in[6] > static_cast<uint8_t>(GpuKind::Discrete)) return false;
+
+    HwFacts out{};
+    const uint8_t f = in[7];
+    out.gpu_kind = static_cast<GpuKind>(in[6]);
+    out.has_discrete_gpu = (f & static_cast<uint8_t>(HwFlag::DiscreteGpu)) != 0;
+    out.is_apple_silicon = (f & kAppleSiliconBit) != 0;
+    out.is_intel_arc = (f & static_cast<uint8_t>(HwFlag::IntelArc)) != 0;
+    out.is_virtual_machine = (f & static_cast<uint8_t>(HwFlag::VirtualMachine)) != 0;
+    out.ram_bytes = get_u64(in + 8);
+    out.vram_bytes = get_u64(in + 16);
+    out.physical_cores = static_cast<int>(get_u32(in + 24));
+    out.logical_threads = static_cast<int>(get_u32(in + 28));
+    out.cpu_steal_percent = in[32];
+    if (generation) *generation = get_u32(in + 36);
+    hw = out;
+    return true;
+}
+
+bool query_casted(HwFacts& hw, const char* socket_path) {
+#if defined(_WIN32)
+    (void)hw;
+    (void)socket_path;
+    return false;
+#else
+    if (!socket_path) {
+        const char* env = std::getenv("CASTE_SOCKET");
+        socket_path = env && *env ? env : kCastedSocketPath;
+    }
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(socket_path) >= sizeof(addr.sun_path)) return false;
+    std::strcpy(addr.sun_path, socket_path);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    uint8_t request[kCastedRequestSize] = {'C', 'S', 'T', kCastedVersion, kCastedOpFacts, 0, 0, 0};
+    uint8_t record[kCastedRecordSize];
+    const Deadline deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kQueryTimeoutMs);
+    const bool ok = connect_by(fd, addr, deadline) &&
+                    transfer(fd, request, sizeof(request), true, deadline) &&
+                    transfer(fd, record, sizeof(record), false, deadline);
+    ::close(fd);
+    return ok && decode_casted_record(record, sizeof(record), hw);
+#endif
+}
+
+HwFacts cached_hw_facts() {
+    HwFacts hw;
+    if (query_casted(hw)) return hw;
+    return detect_hw_facts();
+}
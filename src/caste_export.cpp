@@ -0,0 +1,92 @@
+#include "caste.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// Single-quoted, with the format's way of writing a quote (and, for fish, a
+// backslash) inside one.
+std::string single_quoted(const std::string& v, ExportFormat format) {
+    std::string out = "'";
+    for (char c : v) {
+        if (c == '\'') {
+            out += format == ExportFormat::Sh ? "'\\''" : format == ExportFormat::Fish ? "\\'" : "''";
+        } else if (c == '\\' && format == ExportFormat::Fish) {
+            out += "\\\\";
+        } else {
+            out += c;
+        }
+    }
+    return out + "'";
+}
+
+bool plain_word(const std::string& v) {
+    return !v.empty() && std::all_of(v.begin(), v.end(), [](char c) {
+        return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' ||
+               c == '_' || c == '.';
+    });
+}
+
+// Unquoted when that is unambiguous: plain words, and an empty value, which
+// dotenv readers (and caste_detect()) take as "" rather than two quotes.
+std::string dotenv_value(const std::string& v) {
+    if (v.empty() || plain_word(v)) return v;
+    std::string out = "\"";
+    for (char c : v) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+} // namespace
+
+bool parse_export_format(const std::string& name, ExportFormat& out) {
+    if (name == "sh") out = ExportFormat::Sh;
+    else if (name == "fish") out = ExportFormat::Fish;
+    else if (name == "powershell") out = ExportFormat::PowerShell;
+    else if (name == "dotenv") out = ExportFormat::Dotenv;
+    else return false;
+    return true;
+}
+
+std::vector<ExportVariable> export_variables(const HwFacts& hw, const CasteResult& result,
+                                             const ThreadPoolSizes& pools, const BuildJobs& jobs) {
+    // glibc creates up to 8 arenas per core; each holds freed memory of its
+    // own. One per compute thread is enough, and two on small machines.
+    const int arenas = result.caste <= Caste::User ? 2 : std::clamp(pools.compute, 2, 8);
+    return {
+        {"CASTE", caste_name(result.caste)},
+        {"CASTE_THREADS", std::to_string(hw.logical_threads)},
+        {"CASTE_CORES", std::to_string(hw.physical_cores)},
+        {"CASTE_RAM_BYTES", std::to_string(hw.ram_bytes)},
+        {"CASTE_VRAM_BYTES", std::to_string(hw.vram_bytes)},
+        {"CASTE_ISA_LEVEL", detect_isa_level()},
+        {"CASTE_COMPILE_JOBS", std::to_string(jobs.compile)},
+        {"CASTE_LINK_JOBS", std::to_string(jobs.link)},
+        {"OMP_NUM_THREADS", std::to_string(std::max(pools.compute, 1))},
+        {"MALLOC_ARENA_MAX", std::to_string(arenas)},
+    };
+}
+
+std::string format_exports(const std::vector<ExportVariable>& vars, ExportFormat format) {
+    std::string out;
+    for (const ExportVariable& v : vars) {
+        switch (format) {
+            case ExportFormat::Sh:
+                out += std::string("export ") + v.name + "=" + single_quoted(v.value, format);
+                break;
+            case ExportFormat::Fish:
+                out += std::string("set -gx ") + v.name + " " + single_quoted(v.value, format);
+                break;
+            case ExportFormat::PowerShell:
+                out += std::string("$env:") + v.name + " = " + single_quoted(v.value, format);
+                break;
+            case ExportFormat::Dotenv:
+                out += std::string(v.name) + "=" + dotenv_value(v.value);
+                break;
+        }
+        out += '\n';
+    }
+    return out;
+}
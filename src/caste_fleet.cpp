@@ -0,0 +1,366 @@
+#include "caste.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// caste-fleet: classify hardware-facts telemetry in bulk.
+//
+// The input is memory-mapped and cut into chunks on line boundaries; each
+// wave of chunks is parsed and classified in parallel (classify_many), the
+// results are written in input order, and the pages are dropped again, so
+// memory use stays bounded by jobs * kFleetChunkBytes for any file size.
+
+namespace {
+
+// ---- Memory-mapped input ----
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    // Hint that [offset, offset + len) will not be read again.
+    void release(size_t offset, size_t len);
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#if defined(_WIN32)
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const std::string& path, std::string& error) {
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        error = "cannot open file";
+        return false;
+    }
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file_, &size)) {
+        error = "cannot stat file";
+        return false;
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0) return true;
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_) {
+        error = "cannot map file";
+        return false;
+    }
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (!data_) {
+        error = "cannot map file";
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = INVALID_HANDLE_VALUE;
+    size_ = 0;
+}
+
+void MappedFile::release(size_t, size_t) {
+    // The working-set manager trims clean file-backed pages on its own.
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        error = std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        error = std::strerror(errno);
+        size_ = 0;
+        return false;
+    }
+    data_ = static_cast<const char*>(p);
+#if defined(MADV_SEQUENTIAL)
+    madvise(p, size_, MADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+void MappedFile::release(size_t offset, size_t len) {
+#if defined(MADV_DONTNEED)
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / page * page;
+    const size_t end = offset + len;
+    if (end > begin) madvise(const_cast<char*>(data_) + begin, end - begin, MADV_DONTNEED);
+#else
+    (void)offset;
+    (void)len;
+#endif
+}
+
+#endif
+
+struct Job {
+    const char* data = nullptr;
+    const FleetRecordParser* parser = nullptr;
+    const CastePolicy* policy = nullptr;
+    bool want_records = false;
+};
+
+struct Chunk {
+    size_t begin = 0;
+    size_t end = 0;
+    FleetChunk result;
+};
+
+void process_chunk(const Job& job, Chunk& chunk) {
+    chunk.result = classify_fleet_chunk(*job.parser, std::string_view(job.data + chunk.begin, chunk.end - chunk.begin),
+                                        *job.policy, job.want_records);
+}
+
+bool ends_with(const std::string& s, const char* suffix) {
+    const size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// A positive decimal thread count; anything else (letters, 0, overflow) is
+// rejected rather than read as "all CPUs".
+bool parse_jobs(const char* s, unsigned& out) {
+    if (*s < '0' || *s > '9') return false;
+    errno = 0;
+    char* end = nullptr;
+    const unsigned long v = std::strtoul(s, &end, 10);
+    if (*end != '\0' || errno == ERANGE || v == 0 || v > 0xFFFFu) return false;
+    out = static_cast<unsigned>(v);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool want_help = false;
+    bool want_version = false;
+    bool want_records = false;
+    std::string format_name;
+    std::string policy_path;
+    std::string path;
+    unsigned jobs = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            want_help = true;
+        } else if (arg == "--version") {
+            want_version = true;
+        } else if (arg == "--records") {
+            want_records = true;
+        } else if (arg == "--format" && i + 1 < argc) {
+            format_name = argv[++i];
+        } else if (arg.rfind("--format=", 0) == 0) {
+            format_name = arg.substr(9);
+        } else if (arg == "--policy" && i + 1 < argc) {
+            policy_path = argv[++i];
+        } else if (arg.rfind("--policy=", 0) == 0) {
+            policy_path = arg.substr(9);
+        } else if ((arg == "--jobs" && i + 1 < argc) || arg.rfind("--jobs=", 0) == 0) {
+            const char* value = arg == "--jobs" ? argv[++i] : argv[i] + 7;
+            if (!parse_jobs(value, jobs)) {
+                std::cerr << "caste-fleet: --jobs needs a positive number, not '" << value << "'\n";
+                return 1;
+            }
+        } else if (arg == "--format" || arg == "--policy" || arg == "--jobs") {
+            std::cerr << "caste-fleet: " << arg << " needs a value\n";
+            return 1;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "caste-fleet: unknown option '" << arg << "'\n";
+            return 1;
+        } else if (!path.empty()) {
+            std::cerr << "caste-fleet: more than one input file ('" << path << "', '" << arg << "')\n";
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+
+    if (want_help) {
+        std::cout << "Usage: caste-fleet [--format csv|ndjson] [--records] [--policy FILE] [--jobs N] FILE\n"
+                     "  Classifies hardware-facts records and prints a caste histogram.\n"
+                     "  --format    Input format (default: from the file extension).\n"
+                     "  --records   Print one caste per record instead; the histogram goes to stderr.\n"
+                     "  --policy FILE Classify with thresholds from FILE.\n"
+                     "  --jobs N    Worker threads (default: all CPUs).\n"
+                     "  --version   Show version.\n"
+                     "  -h, --help  Show this help.\n";
+        return 0;
+    }
+
+    if (want_version) {
+        std::cout << "caste-fleet " << CASTE_VERSION << "\n";
+        return 0;
+    }
+
+    if (path.empty()) {
+        std::cerr << "caste-fleet: no input file (see --help)\n";
+        return 1;
+    }
+
+    CastePolicy policy = kDefaultCastePolicy;
+    if (!policy_path.empty()) {
+        std::string error;
+        if (!load_policy_file(policy_path, policy, &error)) {
+            std::cerr << "caste-fleet: " << policy_path << ": " << error << "\n";
+            return 1;
+        }
+    }
+
+    MappedFile file;
+    std::string error;
+    if (!file.open(path, error)) {
+        std::cerr << "caste-fleet: " << path << ": " << error << "\n";
+        return 1;
+    }
+    const char* data = file.data();
+    const size_t size = file.size();
+
+    FleetFormat format = FleetFormat::Csv;
+    if (format_name == "ndjson" || format_name == "jsonl") {
+        format = FleetFormat::Ndjson;
+    } else if (format_name == "csv") {
+        format = FleetFormat::Csv;
+    } else if (!format_name.empty()) {
+        std::cerr << "caste-fleet: unknown format '" << format_name << "'\n";
+        return 1;
+    } else if (ends_with(path, ".ndjson") || ends_with(path, ".jsonl") || ends_with(path, ".json")) {
+        format = FleetFormat::Ndjson;
+    } else if (!ends_with(path, ".csv")) {
+        // Sniff: JSON lines start with '{'.
+        size_t i = 0;
+        while (i < size && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n')) i++;
+        if (i < size && data[i] == '{') format = FleetFormat::Ndjson;
+    }
+
+    // CSV: the header line names the columns.
+    FleetRecordParser parser(format);
+    size_t offset = 0;
+    uint64_t line_base = 0;
+    if (format == FleetFormat::Csv && size > 0) {
+        const void* nl = std::memchr(data, '\n', size);
+        const size_t header_end = nl ? static_cast<size_t>(static_cast<const char*>(nl) - data) : size;
+        if (!parser.set_header(std::string_view(data, header_end))) {
+            std::cerr << "caste-fleet: " << path << ": header has no ram_bytes column\n";
+            return 1;
+        }
+        offset = nl ? header_end + 1 : size;
+        line_base = 1;
+    }
+
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    Job job;
+    job.data = data;
+    job.parser = &parser;
+    job.policy = &policy;
+    job.want_records = want_records;
+
+    uint64_t counts[5] = {};
+    uint64_t invalid = 0;
+    uint64_t first_invalid_line = 0;
+    std::vector<Chunk> wave;
+    std::vector<std::thread> workers;
+    while (offset < size) {
+        wave.clear();
+        while (offset < size && wave.size() < jobs) {
+            Chunk c;
+            c.begin = offset;
+            c.end = fleet_chunk_end(data, size, offset);
+            offset = c.end;
+            wave.push_back(std::move(c));
+        }
+
+        workers.clear();
+        for (size_t k = 1; k < wave.size(); k++) {
+            workers.emplace_back(process_chunk, std::cref(job), std::ref(wave[k]));
+        }
+        process_chunk(job, wave[0]);
+        for (std::thread& t : workers) t.join();
+
+        for (const Chunk& chunk : wave) {
+            const FleetChunk& c = chunk.result;
+            if (want_records) std::fwrite(c.records.data(), 1, c.records.size(), stdout);
+            for (int k = 0; k < 5; k++) counts[k] += c.counts[k];
+            if (c.invalid && invalid == 0) first_invalid_line = line_base + c.first_invalid_line;
+            invalid += c.invalid;
+            line_base += c.lines;
+        }
+        file.release(wave.front().begin, wave.back().end - wave.front().begin);
+    }
+    std::fflush(stdout);
+
+    uint64_t total = invalid;
+    for (uint64_t n : counts) total += n;
+
+    FILE* summary = want_records ? stderr : stdout;
+    for (int k = 0; k < 5; k++) {
+        std::fprintf(summary, "%-12s %12llu %6.2f%%\n", caste_name(static_cast<Caste>(k)),
+                     static_cast<unsigned long long>(counts[k]),
+                     total ? 100.0 * static_cast<double>(counts[k]) / static_cast<double>(total) : 0.0);
+    }
+    if (invalid) {
+        std::fprintf(summary, "%-12s %12llu\n", "invalid", static_cast<unsigned long long>(invalid));
+        std::fprintf(stderr, "caste-fleet: %s:%llu: first record that could not be parsed\n",
+                     path.c_str(), static_cast<unsigned long long>(first_invalid_line));
+    }
+    return 0;
+}
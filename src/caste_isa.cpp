@@ -0,0 +1,86 @@
+#include "caste.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+struct CpuidRegs {
+    unsigned a = 0, b = 0, c = 0, d = 0;
+};
+
+CpuidRegs cpuid(unsigned leaf, unsigned sub = 0) {
+    CpuidRegs r;
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(sub));
+    r.a = static_cast<unsigned>(regs[0]);
+    r.b = static_cast<unsigned>(regs[1]);
+    r.c = static_cast<unsigned>(regs[2]);
+    r.d = static_cast<unsigned>(regs[3]);
+#else
+    __cpuid_count(leaf, sub, r.a, r.b, r.c, r.d);
+#endif
+    return r;
+}
+
+// XCR0: which register states the OS saves on context switch.
+unsigned long long xcr0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo = 0, hi = 0;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+
+bool has_bits(unsigned reg, unsigned mask) {
+    return (reg & mask) == mask;
+}
+
+// x86-64 psABI microarchitecture levels.
+const char* x86_64_level() {
+    const unsigned max_leaf = cpuid(0).a;
+    const CpuidRegs l1 = cpuid(1);
+    const CpuidRegs l7 = max_leaf >= 7 ? cpuid(7) : CpuidRegs{};
+    const CpuidRegs e1 = cpuid(0x80000000).a >= 0x80000001 ? cpuid(0x80000001) : CpuidRegs{};
+
+    // SSE3, SSSE3, CMPXCHG16B, SSE4.1, SSE4.2, POPCNT; LAHF/SAHF
+    const bool v2 = has_bits(l1.c, 1u << 0 | 1u << 9 | 1u << 13 | 1u << 19 | 1u << 20 | 1u << 23) &&
+                    has_bits(e1.c, 1u << 0);
+    if (!v2) return "x86-64";
+
+    // AVX state must be enabled by the OS (OSXSAVE, then XCR0 SSE|AVX).
+    const bool os_avx = has_bits(l1.c, 1u << 27) && (xcr0() & 0x6) == 0x6;
+    // FMA, MOVBE, AVX, F16C; BMI1, AVX2, BMI2; LZCNT
+    const bool v3 = os_avx && has_bits(l1.c, 1u << 12 | 1u << 22 | 1u << 28 | 1u << 29) &&
+                    has_bits(l7.b, 1u << 3 | 1u << 5 | 1u << 8) && has_bits(e1.c, 1u << 5);
+    if (!v3) return "x86-64-v2";
+
+    // AVX512F, DQ, CD, BW, VL with opmask/ZMM state enabled
+    const bool v4 = (xcr0() & 0xe0) == 0xe0 &&
+                    has_bits(l7.b, 1u << 16 | 1u << 17 | 1u << 28 | 1u << 30 | 1u << 31);
+    return v4 ? "x86-64-v4" : "x86-64-v3";
+}
+
+#endif
+
+} // namespace
+
+const char* detect_isa_level() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return x86_64_level();
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    return "armv8-a";
+#else
+    return "";
+#endif
+}
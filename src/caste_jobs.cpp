@@ -0,0 +1,42 @@
+#include "caste.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+int jobs_for(uint64_t bytes, uint64_t per_job) {
+    if (per_job == 0) return INT32_MAX;
+    return static_cast<int>(std::min<uint64_t>(bytes / per_job, INT32_MAX));
+}
+
+} // namespace
+
+BuildJobs recommend_build_jobs(const CpuTopology& topology, const MemoryFacts& mem, const BuildJobOptions& options) {
+    int cpus = topology.allowed_threads;
+    if (cpus <= 0) {
+        for (const CpuGroup& g : topology.groups) cpus += static_cast<int>(g.cpus.size());
+    }
+    if (topology.cpu_quota > 0.0) {
+        cpus = std::min(cpus, static_cast<int>(std::ceil(topology.cpu_quota)));
+    }
+
+    // Free memory after the reserve, without any caste share.
+    MemoryHeadroomPolicy headroom = options.headroom;
+    headroom.caste_share = {1.0, 1.0, 1.0, 1.0, 1.0};
+    headroom.tenants = 1;
+    const uint64_t usable = recommend_memory_budget(mem, Caste::Rig, headroom).claimable_bytes;
+
+    // Ninja runs both pools at once: compiles leave room for one link, and
+    // the link pool gets what the compiles leave over.
+    const uint64_t link = options.link_job_bytes;
+    BuildJobs out;
+    out.compile = std::max(1, std::min(cpus, jobs_for(usable > link ? usable - link : 0, options.compile_job_bytes)));
+    const uint64_t compiling = static_cast<uint64_t>(out.compile) * options.compile_job_bytes;
+    out.link = std::max(1, std::min(out.compile, jobs_for(usable > compiling ? usable - compiling : 0, link)));
+    return out;
+}
+
+BuildJobs recommend_build_jobs(const BuildJobOptions& options) {
+    return recommend_build_jobs(detect_cpu_topology(), detect_memory_facts(), options);
+}
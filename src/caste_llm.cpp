@@ -0,0 +1,128 @@
+#include "caste.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// llama.cpp's scratch/compute buffers; on the GPU when any layer is there.
+constexpr uint64_t kComputeBuffer = caste_detail::MiB(512);
+constexpr int kMinContext = 512;
+constexpr int kDefaultContext = 4096;
+
+uint64_t fraction_of(uint64_t bytes, double f) {
+    return static_cast<uint64_t>(static_cast<double>(bytes) * f);
+}
+
+uint64_t minus(uint64_t a, uint64_t b) {
+    return a > b ? a - b : 0;
+}
+
+uint64_t weight_bytes_for(uint64_t params, LlmQuant q) {
+    return static_cast<uint64_t>(static_cast<double>(params) * llm_quant_bits(q) / 8.0);
+}
+
+// Parameters whose weights fill 85% of the budget.
+uint64_t params_for(uint64_t bytes, LlmQuant q) {
+    return static_cast<uint64_t>(static_cast<double>(bytes) * 0.85 * 8.0 / llm_quant_bits(q));
+}
+
+} // namespace
+
+const char* llm_quant_name(LlmQuant q) {
+    switch (q) {
+        case LlmQuant::Q4_K_M: return "q4_k_m";
+        case LlmQuant::Q5_K_M: return "q5_k_m";
+        case LlmQuant::Q8_0: return "q8_0";
+        case LlmQuant::F16: return "f16";
+    }
+    return "unknown";
+}
+
+LlmMemoryBudget llm_memory_budget(const HwFacts& hw, const LlmBudgetOptions& options) {
+    LlmMemoryBudget out;
+    const uint64_t host_reserve =
+        std::max(options.host_reserve_min, fraction_of(hw.ram_bytes, options.host_reserve_fraction));
+    const uint64_t host_usable = minus(hw.ram_bytes, host_reserve);
+
+    if (hw.gpu_kind == GpuKind::Discrete || hw.has_discrete_gpu) {
+        const uint64_t reserve =
+            std::max(options.vram_reserve_min, fraction_of(hw.vram_bytes, options.vram_reserve_fraction));
+        out.gpu_bytes = minus(hw.vram_bytes, reserve);
+        out.host_bytes = host_usable;
+    } else if (hw.is_apple_silicon || hw.gpu_kind == GpuKind::Unified) {
+        // One pool: the GPU may wire part of it, the rest is left for CPU layers.
+        out.unified = true;
+        out.gpu_bytes = std::min(fraction_of(hw.ram_bytes, options.unified_gpu_fraction), host_usable);
+        out.host_bytes = host_usable - out.gpu_bytes;
+    } else {
+        // Integrated GPUs share system RAM without a fast path; plan for the CPU.
+        out.host_bytes = host_usable;
+    }
+    return out;
+}
+
+std::array<LlmQuantFit, 4> llm_capacity(const HwFacts& hw, const LlmBudgetOptions& options) {
+    const LlmMemoryBudget budget = llm_memory_budget(hw, options);
+    const uint64_t gpu = minus(budget.gpu_bytes, kComputeBuffer);
+    const uint64_t total = minus(budget.gpu_bytes + budget.host_bytes, kComputeBuffer);
+
+    std::array<LlmQuantFit, 4> out{};
+    for (size_t i = 0; i < out.size(); i++) {
+        const LlmQuant q = kAllLlmQuants[i];
+        out[i].quant = q;
+        out[i].max_params_gpu = params_for(gpu, q);
+        out[i].max_params_total = params_for(total, q);
+    }
+    return out;
+}
+
+LlmPlan plan_llm(const HwFacts& hw, const LlmModel& model, const LlmBudgetOptions& options) {
+    LlmPlan plan;
+    if (model.params == 0 || model.layers <= 0) return plan;
+
+    const LlmMemoryBudget budget = llm_memory_budget(hw, options);
+    const uint64_t layers = static_cast<uint64_t>(model.layers);
+    plan.weight_bytes = weight_bytes_for(model.params, model.quant);
+    const uint64_t layer_bytes = (plan.weight_bytes + layers - 1) / layers;
+    const uint64_t kv_dim = static_cast<uint64_t>(std::max(model.kv_dim, 0));
+    const uint64_t kv_per_token_layer = 2 * kv_dim * static_cast<uint64_t>(std::max(model.kv_bytes_per_value, 0));
+    const bool have_gpu = budget.gpu_bytes > kComputeBuffer;
+    const uint64_t gpu_room = minus(budget.gpu_bytes, kComputeBuffer);
+
+    // Keep the requested context and move layers to the host first; shorten
+    // the context only when the whole model does not fit.
+    int context = model.max_context > 0 ? model.max_context : kDefaultContext;
+    for (;;) {
+        const uint64_t per_layer = layer_bytes + kv_per_token_layer * static_cast<uint64_t>(context);
+        const uint64_t gpu_layers = have_gpu && per_layer > 0 ? std::min(layers, gpu_room / per_layer) : 0;
+        const uint64_t gpu_used = gpu_layers > 0 ? gpu_layers * per_layer + kComputeBuffer : 0;
+        const uint64_t host_used = (layers - gpu_layers) * per_layer + (gpu_layers == 0 ? kComputeBuffer : 0);
+
+        if (host_used <= budget.host_bytes) {
+            plan.fits = true;
+            plan.gpu_layers = static_cast<int>(gpu_layers);
+            plan.context_length = context;
+            plan.kv_cache_bytes = kv_per_token_layer * layers * static_cast<uint64_t>(context);
+            plan.gpu_bytes_used = gpu_used;
+            plan.host_bytes_used = host_used;
+
+            // Decode reads every weight once per token.
+            const double gpu_weights = static_cast<double>(gpu_layers * layer_bytes);
+            const double host_weights = static_cast<double>((layers - gpu_layers) * layer_bytes);
+            const bool gpu_ok = gpu_weights == 0.0 || options.gpu_bandwidth_bytes_per_sec > 0.0;
+            const bool host_ok = host_weights == 0.0 || options.host_bandwidth_bytes_per_sec > 0.0;
+            if (gpu_ok && host_ok) {
+                double seconds = 0.0;
+                if (gpu_weights > 0.0) seconds += gpu_weights / options.gpu_bandwidth_bytes_per_sec;
+                if (host_weights > 0.0) seconds += host_weights / options.host_bandwidth_bytes_per_sec;
+                if (seconds > 0.0) plan.decode_tokens_per_sec = 1.0 / seconds;
+            }
+            return plan;
+        }
+        if (context <= kMinContext) break;
+        context = std::max(context / 2, kMinContext);
+    }
+
+    plan.context_length = 0;
+    return plan;
+}
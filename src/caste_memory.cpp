@@ -0,0 +1,46 @@
+#include "caste.hpp"
+
+#include <algorithm>
+
+namespace {
+
+uint64_t fraction_of(uint64_t bytes, double f) {
+    return static_cast<uint64_t>(static_cast<double>(bytes) * std::clamp(f, 0.0, 1.0));
+}
+
+uint64_t minus(uint64_t a, uint64_t b) {
+    return a > b ? a - b : 0;
+}
+
+} // namespace
+
+MemoryBudget recommend_memory_budget(const MemoryFacts& mem, Caste caste, const MemoryHeadroomPolicy& policy) {
+    MemoryBudget out;
+    out.limit_bytes = mem.total_bytes;
+    if (mem.cgroup_limit_bytes && (out.limit_bytes == 0 || mem.cgroup_limit_bytes < out.limit_bytes)) {
+        out.limit_bytes = mem.cgroup_limit_bytes;
+    }
+
+    // Memory other tenants already use is outside MemAvailable and the cgroup
+    // headroom; tenants still to start are split off below.
+    out.free_bytes = mem.available_bytes ? std::min(mem.available_bytes, out.limit_bytes) : out.limit_bytes;
+    if (mem.cgroup_limit_bytes) {
+        out.free_bytes = std::min(out.free_bytes, minus(mem.cgroup_limit_bytes, mem.cgroup_usage_bytes));
+    }
+
+    const uint64_t reserve = std::max(policy.reserve_min, fraction_of(out.limit_bytes, policy.reserve_fraction));
+    const size_t tier = std::min(static_cast<size_t>(caste), policy.caste_share.size() - 1);
+    out.claimable_bytes = fraction_of(minus(out.free_bytes, reserve), policy.caste_share[tier]);
+    if (policy.tenants > 1) out.claimable_bytes /= static_cast<uint64_t>(policy.tenants);
+
+    out.hot_cache_bytes = fraction_of(out.claimable_bytes, policy.hot_fraction);
+    out.warm_cache_bytes = std::min(fraction_of(out.claimable_bytes, policy.warm_fraction),
+                                    out.claimable_bytes - out.hot_cache_bytes);
+    out.scratch_bytes = std::min(fraction_of(out.claimable_bytes, policy.scratch_fraction),
+                                 out.claimable_bytes - out.hot_cache_bytes - out.warm_cache_bytes);
+    return out;
+}
+
+MemoryBudget recommend_memory_budget(const MemoryHeadroomPolicy& policy) {
+    return recommend_memory_budget(detect_memory_facts(), detect_caste().caste, policy);
+}
@@ -0,0 +1,144 @@
+#include "caste.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+static std::string trim(std::string s) {
+    auto notspace = [](unsigned char c){ return c != ' ' && c != '\t' && c != '\n' && c != '\r'; };
+    while (!s.empty() && !notspace((unsigned char)s.front())) s.erase(s.begin());
+    while (!s.empty() && !notspace((unsigned char)s.back())) s.pop_back();
+    return s;
+}
+
+static void set_error(std::string* error, const std::string& msg) {
+    if (error) *error = msg;
+}
+
+static CastePolicy::Table* table_for_key(CastePolicy& p, const std::string& key) {
+    if (key == "vram_min") return &p.vram_min;
+    if (key == "unified_ram_min") return &p.unified_ram_min;
+    if (key == "ram_cap_min") return &p.ram_cap_min;
+    if (key == "cpu_cores_min") return &p.cpu_cores_min;
+    if (key == "cpu_threads_min") return &p.cpu_threads_min;
+    return nullptr;
+}
+
+} // namespace
+
+bool parse_size_bytes(const std::string& tok, uint64_t& out) {
+    const char* begin = tok.c_str();
+    char* end = nullptr;
+    double v = std::strtod(begin, &end);
+    if (end == begin || !std::isfinite(v) || v < 0.0) return false;
+
+    std::string unit = end;
+    for (char& c : unit) c = (char)std::tolower((unsigned char)c);
+    double mult = 1.0;
+    if (unit.empty() || unit == "b") mult = 1.0;
+    else if (unit == "k" || unit == "kib") mult = 1024.0;
+    else if (unit == "m" || unit == "mib") mult = 1024.0 * 1024.0;
+    else if (unit == "g" || unit == "gib") mult = 1024.0 * 1024.0 * 1024.0;
+    else if (unit == "t" || unit == "tib") mult = 1024.0 * 1024.0 * 1024.0 * 1024.0;
+    else return false;
+
+    const double bytes = v * mult;
+    if (bytes >= 18446744073709551616.0) return false; // 2^64: the cast would be undefined
+    out = static_cast<uint64_t>(bytes);
+    return true;
+}
+
+bool validate_policy(const CastePolicy& policy, std::string* error) {
+    const struct {
+        const char* name;
+        const CastePolicy::Table* table;
+    } tables[] = {
+        {"vram_min", &policy.vram_min},
+        {"unified_ram_min", &policy.unified_ram_min},
+        {"ram_cap_min", &policy.ram_cap_min},
+        {"cpu_cores_min", &policy.cpu_cores_min},
+        {"cpu_threads_min", &policy.cpu_threads_min},
+    };
+    for (const auto& t : tables) {
+        for (size_t i = 1; i < t.table->size(); i++) {
+            if ((*t.table)[i] < (*t.table)[i - 1]) {
+                set_error(error, std::string(t.name) + ": " + caste_name(static_cast<Caste>(i)) +
+                                 " threshold is below " + caste_name(static_cast<Caste>(i - 1)));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool parse_policy(const std::string& text, CastePolicy& out, std::string* error) {
+    CastePolicy p = kDefaultCastePolicy;
+
+    std::istringstream in(text);
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        auto hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        line = trim(line);
+        if (line.empty()) continue;
+
+        const std::string where = "line " + std::to_string(lineno) + ": ";
+        auto eq = line.find('=');
+        if (eq == std::string::npos) {
+            set_error(error, where + "expected 'key = value'");
+            return false;
+        }
+        std::string key = trim(line.substr(0, eq));
+        std::istringstream values(line.substr(eq + 1));
+        std::vector<uint64_t> nums;
+        std::string tok;
+        while (values >> tok) {
+            uint64_t v = 0;
+            if (!parse_size_bytes(tok, v)) {
+                set_error(error, where + "bad value '" + tok + "'");
+                return false;
+            }
+            nums.push_back(v);
+        }
+
+        if (auto* table = table_for_key(p, key)) {
+            if (nums.size() != table->size()) {
+                set_error(error, where + key + " needs 5 values (Mini User Developer Workstation Rig)");
+                return false;
+            }
+            for (size_t i = 0; i < nums.size(); i++) (*table)[i] = nums[i];
+        } else if (key == "ram_floor" || key == "arc_bump_ram") {
+            if (nums.size() != 1) {
+                set_error(error, where + key + " needs one value");
+                return false;
+            }
+            (key == "ram_floor" ? p.ram_floor : p.arc_bump_ram) = nums[0];
+        } else {
+            set_error(error, where + "unknown key '" + key + "'");
+            return false;
+        }
+    }
+
+    if (!validate_policy(p, error)) return false;
+    out = p;
+    return true;
+}
+
+bool load_policy_file(const std::string& path, CastePolicy& out, std::string* error) {
+    std::ifstream f(path);
+    if (!f) {
+        set_error(error, "cannot open " + path);
+        return false;
+    }
+    std::ostringstream ss;
+    ss << f.rdbuf();
+    return parse_policy(ss.str(), out, error);
+}
@@ -0,0 +1,317 @@
+#include "caste.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Record parsing for caste-fleet, in the library so it can be tested without
+// the memory-mapping driver.
+
+enum class FleetField : uint8_t {
+    Ignore,
+    RamBytes,
+    PhysicalCores,
+    LogicalThreads,
+    GpuKindField,
+    VramBytes,
+    HasDiscreteGpu,
+    IsAppleSilicon,
+    IsIntelArc,
+    IsVirtualMachine,
+    CpuStealPercent,
+};
+
+namespace {
+
+using Field = FleetField;
+
+constexpr uint8_t kInvalid = 0xff;
+
+// Column/key names are the HwFacts member names.
+Field field_for_name(std::string_view name) {
+    if (name == "ram_bytes") return Field::RamBytes;
+    if (name == "physical_cores") return Field::PhysicalCores;
+    if (name == "logical_threads") return Field::LogicalThreads;
+    if (name == "gpu_kind") return Field::GpuKindField;
+    if (name == "vram_bytes") return Field::VramBytes;
+    if (name == "has_discrete_gpu") return Field::HasDiscreteGpu;
+    if (name == "is_apple_silicon") return Field::IsAppleSilicon;
+    if (name == "is_intel_arc") return Field::IsIntelArc;
+    if (name == "is_virtual_machine") return Field::IsVirtualMachine;
+    if (name == "cpu_steal_percent") return Field::CpuStealPercent;
+    return Field::Ignore;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+    return s;
+}
+
+std::string_view unquote(std::string_view s) {
+    s = trim(s);
+    if (s.size() >= 2 && s.front() == '"' && s.back() == '"') s = s.substr(1, s.size() - 2);
+    return s;
+}
+
+// Integers, or decimals/exponents (truncated) for exports that write floats.
+bool parse_u64(std::string_view s, uint64_t& out) {
+    const char* end = s.data() + s.size();
+    auto r = std::from_chars(s.data(), end, out);
+    if (r.ec == std::errc() && r.ptr == end) return true;
+    double d = 0;
+    auto rd = std::from_chars(s.data(), end, d);
+    if (rd.ec != std::errc() || rd.ptr != end || !(d >= 0) || d >= 18446744073709551616.0) return false;
+    out = static_cast<uint64_t>(d);
+    return true;
+}
+
+bool parse_int(std::string_view s, int& out) {
+    uint64_t v = 0;
+    if (!parse_u64(s, v) || v > 0x7fffffff) return false;
+    out = static_cast<int>(v);
+    return true;
+}
+
+bool parse_bool(std::string_view s, bool& out) {
+    if (s == "true" || s == "1" || s == "yes") {
+        out = true;
+        return true;
+    }
+    if (s == "false" || s == "0" || s == "no" || s.empty()) {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+bool parse_gpu_kind(std::string_view s, GpuKind& out) {
+    if (s == "discrete" || s == "3") out = GpuKind::Discrete;
+    else if (s == "unified" || s == "2") out = GpuKind::Unified;
+    else if (s == "integrated" || s == "1") out = GpuKind::Integrated;
+    else if (s == "none" || s == "unknown" || s == "0" || s.empty()) out = GpuKind::None;
+    else return false;
+    return true;
+}
+
+bool set_field(HwFacts& hw, Field field, std::string_view v) {
+    switch (field) {
+        case Field::Ignore: return true;
+        case Field::RamBytes: return parse_u64(v, hw.ram_bytes);
+        case Field::PhysicalCores: return parse_int(v, hw.physical_cores);
+        case Field::LogicalThreads: return parse_int(v, hw.logical_threads);
+        case Field::GpuKindField: return parse_gpu_kind(v, hw.gpu_kind);
+        case Field::VramBytes: return parse_u64(v, hw.vram_bytes);
+        case Field::HasDiscreteGpu: return parse_bool(v, hw.has_discrete_gpu);
+        case Field::IsAppleSilicon: return parse_bool(v, hw.is_apple_silicon);
+        case Field::IsIntelArc: return parse_bool(v, hw.is_intel_arc);
+        case Field::IsVirtualMachine: return parse_bool(v, hw.is_virtual_machine);
+        case Field::CpuStealPercent: {
+            uint64_t pct = 0;
+            if (!parse_u64(v, pct)) return false;
+            hw.cpu_steal_percent = static_cast<uint8_t>(pct > 100 ? 100 : pct);
+            return true;
+        }
+    }
+    return false;
+}
+
+// ---- Record formats ----
+
+// Splits on commas outside double quotes; calls fn(index, field).
+template <typename Fn>
+void split_csv(std::string_view line, Fn&& fn) {
+    size_t index = 0, start = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"') quoted = !quoted;
+        else if (line[i] == ',' && !quoted) {
+            fn(index++, line.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    fn(index, line.substr(start));
+}
+
+bool parse_csv_record(std::string_view line, const std::vector<Field>& columns, HwFacts& hw) {
+    bool ok = true;
+    size_t seen = 0;
+    split_csv(line, [&](size_t i, std::string_view v) {
+        seen = i + 1;
+        if (i < columns.size() && !set_field(hw, columns[i], unquote(v))) ok = false;
+    });
+    return ok && seen == columns.size();
+}
+
+// Flat JSON objects only; nested values are skipped (their key is ignored).
+class JsonCursor {
+public:
+    explicit JsonCursor(std::string_view s) : s_(s) {}
+
+    void skip_ws() {
+        while (i_ < s_.size() && (s_[i_] == ' ' || s_[i_] == '\t' || s_[i_] == '\r')) i_++;
+    }
+    bool eat(char c) {
+        skip_ws();
+        if (i_ < s_.size() && s_[i_] == c) {
+            i_++;
+            return true;
+        }
+        return false;
+    }
+    bool at_end() {
+        skip_ws();
+        return i_ == s_.size();
+    }
+
+    // Raw string contents; escapes are kept (field names and values never need them).
+    bool string(std::string_view& out) {
+        if (!eat('"')) return false;
+        const size_t start = i_;
+        while (i_ < s_.size() && s_[i_] != '"') i_ += (s_[i_] == '\\') ? 2 : 1;
+        if (i_ >= s_.size()) return false;
+        out = s_.substr(start, i_ - start);
+        i_++;
+        return true;
+    }
+
+    // Scalar text (number/true/false/null or string contents); nested values give "".
+    bool value(std::string_view& out) {
+        skip_ws();
+        if (i_ >= s_.size()) return false;
+        if (s_[i_] == '"') return string(out);
+        if (s_[i_] == '{' || s_[i_] == '[') {
+            out = {};
+            return skip_nested();
+        }
+        const size_t start = i_;
+        while (i_ < s_.size() && s_[i_] != ',' && s_[i_] != '}' && s_[i_] != ' ' && s_[i_] != '\t') i_++;
+        out = s_.substr(start, i_ - start);
+        if (out == "null") out = {};
+        return i_ > start;
+    }
+
+private:
+    bool skip_nested() {
+        int depth = 0;
+        while (i_ < s_.size()) {
+            const char c = s_[i_];
+            if (c == '"') {
+                std::string_view ignored;
+                if (!string(ignored)) return false;
+                continue;
+            }
+            i_++;
+            if (c == '{' || c == '[') depth++;
+            else if ((c == '}' || c == ']') && --depth == 0) return true;
+        }
+        return false;
+    }
+
+    std::string_view s_;
+    size_t i_ = 0;
+};
+
+bool parse_ndjson_record(std::string_view line, HwFacts& hw) {
+    JsonCursor j(line);
+    if (!j.eat('{')) return false;
+    bool have_ram = false;
+    if (!j.eat('}')) {
+        do {
+            std::string_view key, v;
+            if (!j.string(key) || !j.eat(':') || !j.value(v)) return false;
+            const Field field = field_for_name(key);
+            if (!set_field(hw, field, v)) return false;
+            have_ram = have_ram || field == Field::RamBytes;
+        } while (j.eat(','));
+        if (!j.eat('}')) return false;
+    }
+    return have_ram && j.at_end();
+}
+
+} // namespace
+
+FleetRecordParser::FleetRecordParser(FleetFormat format) : format_(format) {}
+
+bool FleetRecordParser::set_header(std::string_view line) {
+    columns_.clear();
+    bool have_ram = false;
+    split_csv(trim(line), [&](size_t, std::string_view name) {
+        columns_.push_back(field_for_name(unquote(name)));
+        have_ram = have_ram || columns_.back() == Field::RamBytes;
+    });
+    return have_ram;
+}
+
+bool FleetRecordParser::parse(std::string_view line, HwFacts& out) const {
+    line = trim(line);
+    HwFacts hw{};
+    const bool ok = format_ == FleetFormat::Csv ? parse_csv_record(line, columns_, hw) : parse_ndjson_record(line, hw);
+    if (ok) out = hw;
+    return ok;
+}
+
+FleetChunk classify_fleet_chunk(const FleetRecordParser& parser, std::string_view text, const CastePolicy& policy,
+                                bool want_records) {
+    FleetChunk chunk;
+    std::vector<uint64_t> ram, vram;
+    std::vector<int32_t> cores, threads;
+    std::vector<uint8_t> flags, steal, castes;
+    std::vector<uint32_t> slots;          // record -> line slot in castes
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t nl = text.find('\n', pos);
+        if (nl == std::string_view::npos) nl = text.size();
+        std::string_view line = trim(text.substr(pos, nl - pos));
+        pos = nl + 1;
+        chunk.lines++;
+        if (line.empty()) continue;
+
+        HwFacts hw{};
+        if (!parser.parse(line, hw)) {
+            if (chunk.invalid++ == 0) chunk.first_invalid_line = chunk.lines;
+            castes.push_back(kInvalid);
+            continue;
+        }
+        slots.push_back(static_cast<uint32_t>(castes.size()));
+        castes.push_back(0);
+        ram.push_back(hw.ram_bytes);
+        vram.push_back(hw.vram_bytes);
+        cores.push_back(hw.physical_cores);
+        threads.push_back(hw.logical_threads);
+        flags.push_back(hw_flags(hw));
+        steal.push_back(hw.cpu_steal_percent);
+    }
+
+    HwFactsColumns cols;
+    cols.count = ram.size();
+    cols.ram_bytes = ram.data();
+    cols.vram_bytes = vram.data();
+    cols.physical_cores = cores.data();
+    cols.logical_threads = threads.data();
+    cols.flags = flags.data();
+    cols.cpu_steal_percent = steal.data();
+    std::vector<uint8_t> out(cols.count);
+    classify_many(cols, out.data(), policy);
+
+    for (size_t r = 0; r < out.size(); r++) {
+        castes[slots[r]] = out[r];
+        chunk.counts[out[r]]++;
+    }
+    if (want_records) {
+        for (uint8_t c : castes) {
+            chunk.records += c == kInvalid ? "invalid" : caste_name(static_cast<Caste>(c));
+            chunk.records += '\n';
+        }
+    }
+    return chunk;
+}
+
+size_t fleet_chunk_end(const char* data, size_t size, size_t begin, size_t chunk_bytes) {
+    if (size - begin <= chunk_bytes) return size;
+    const void* nl = std::memchr(data + begin + chunk_bytes, '\n', size - begin - chunk_bytes);
+    return nl ? static_cast<size_t>(static_cast<const char*>(nl) - data) + 1 : size;
+}
@@ -0,0 +1,188 @@
+#include "caste.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// What the seqlock protects. Copied bytewise, so both sides must agree on
+// the layout; the size is part of the header check.
+struct Payload {
+    HwFacts facts;
+    CasteResult result;
+};
+
+static_assert(std::is_trivially_copyable_v<Payload>, "Payload is copied through shared memory");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock words must be lock-free in shared memory");
+
+constexpr uint32_t kMagic = 0x4d545343; // "CSTM"
+constexpr uint32_t kLayoutVersion = 1;
+constexpr size_t kWords = (sizeof(Payload) + 3) / 4;
+constexpr int kMaxAttempts = 1 << 20;
+
+// Relaxed atomic words rather than a plain struct: readers copy while the
+// writer may be mid-update, and the sequence check discards those copies.
+struct Segment {
+    std::atomic<uint32_t> magic;
+    std::atomic<uint32_t> layout;   // version << 16 | payload words
+    std::atomic<uint32_t> sequence; // odd while a write is in progress; 0 = never written
+    uint32_t owner;                 // publisher's pid, so a crashed one can be replaced
+    std::atomic<uint32_t> words[kWords];
+};
+
+constexpr uint32_t kLayout = kLayoutVersion << 16 | static_cast<uint32_t>(kWords);
+
+const char* shm_name(const char* name) {
+    if (name) return name;
+    const char* env = std::getenv("CASTE_SHM");
+    return env && *env ? env : kCasteShmName;
+}
+
+#if !defined(_WIN32)
+// True if name holds a complete segment whose publisher has exited. Anything
+// else (a live publisher, one still sizing its segment, another format) is
+// left alone.
+bool owner_gone(const char* name) {
+    const int fd = ::shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st{};
+    bool gone = false;
+    if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= offsetof(Segment, words)) {
+        void* p = ::mmap(nullptr, offsetof(Segment, words), PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            const auto* seg = static_cast<const Segment*>(p);
+            const pid_t owner = static_cast<pid_t>(seg->owner);
+            gone = seg->magic.load(std::memory_order_acquire) == kMagic && owner > 0 &&
+                   ::kill(owner, 0) != 0 && errno == ESRCH;
+            ::munmap(p, offsetof(Segment, words));
+        }
+    }
+    ::close(fd);
+    return gone;
+}
+#endif
+
+} // namespace
+
+CasteShmPublisher::CasteShmPublisher(const char* name) : name_(shm_name(name)) {
+#if !defined(_WIN32)
+    // Exclusive: a second publisher resetting a live segment would break the
+    // single-writer seqlock. Only a crashed publisher's segment is replaced.
+    int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && owner_gone(name_.c_str())) {
+        ::shm_unlink(name_.c_str());
+        fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0) return;
+    void* p = MAP_FAILED;
+    if (::ftruncate(fd, sizeof(Segment)) == 0) {
+        p = ::mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        ::shm_unlink(name_.c_str());
+        return;
+    }
+
+    // The new segment is zeroed; readers check magic and layout before
+    // trusting the sequence, so magic goes last.
+    auto* seg = static_cast<Segment*>(p);
+    seg->owner = static_cast<uint32_t>(::getpid());
+    seg->layout.store(kLayout, std::memory_order_relaxed);
+    seg->magic.store(kMagic, std::memory_order_release);
+    segment_ = seg;
+#endif
+}
+
+CasteShmPublisher::~CasteShmPublisher() {
+#if !defined(_WIN32)
+    if (!segment_) return;
+    // Readers that mapped the segment keep it after the unlink; clearing the
+    // magic makes their read() fail so they reopen and find the next publisher.
+    static_cast<Segment*>(segment_)->magic.store(0, std::memory_order_release);
+    ::munmap(segment_, sizeof(Segment));
+    ::shm_unlink(name_.c_str());
+#endif
+}
+
+void CasteShmPublisher::publish(const HwFacts& hw, const CasteResult& result) {
+    if (!segment_) return;
+    auto* seg = static_cast<Segment*>(segment_);
+
+    uint32_t words[kWords] = {};
+    const Payload payload{hw, result};
+    std::memcpy(words, &payload, sizeof(payload));
+
+    // Single writer: odd sequence, payload, even sequence.
+    uint32_t seq = seg->sequence.load(std::memory_order_relaxed);
+    if (seq & 1) seq++; // a previous publisher died mid-write
+    seg->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; i++) seg->words[i].store(words[i], std::memory_order_relaxed);
+    seg->sequence.store(seq + 2, std::memory_order_release);
+}
+
+CasteShmReader::CasteShmReader(const char* name) {
+#if !defined(_WIN32)
+    const int fd = ::shm_open(shm_name(name), O_RDONLY, 0);
+    if (fd < 0) return;
+    // Mapping past the end of a smaller segment (another build, or one still
+    // being sized) would fault on first read; treat it as absent.
+    struct stat st{};
+    void* p = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Segment)) {
+        p = ::mmap(nullptr, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (p == MAP_FAILED) return;
+    segment_ = p;
+#else
+    (void)name;
+#endif
+}
+
+CasteShmReader::~CasteShmReader() {
+#if !defined(_WIN32)
+    if (segment_) ::munmap(const_cast<void*>(segment_), sizeof(Segment));
+#endif
+}
+
+bool CasteShmReader::read(CasteSnapshot& out) const {
+    if (!segment_) return false;
+    const auto* seg = static_cast<const Segment*>(segment_);
+    if (seg->magic.load(std::memory_order_acquire) != kMagic) return false;
+    if (seg->layout.load(std::memory_order_relaxed) != kLayout) return false;
+
+    uint32_t words[kWords];
+    uint32_t before = 0;
+    for (int attempt = 0;; attempt++) {
+        // A publisher killed mid-write leaves the sequence odd for good.
+        if (attempt == kMaxAttempts) return false;
+        before = seg->sequence.load(std::memory_order_acquire);
+        if (before == 0) return false;
+        if (before & 1) continue;
+        for (size_t i = 0; i < kWords; i++) words[i] = seg->words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seg->sequence.load(std::memory_order_relaxed) == before) break;
+    }
+
+    Payload payload;
+    std::memcpy(&payload, words, sizeof(payload));
+    out.facts = payload.facts;
+    out.result = payload.result;
+    out.version = before / 2;
+    return true;
+}
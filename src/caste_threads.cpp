@@ -0,0 +1,93 @@
+#include "caste.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int kMinIoThreads = 4;
+constexpr int kMaxIoThreads = 64;
+
+bool is_efficiency(const CpuGroup& g) {
+    return g.core_type == CoreType::Efficiency;
+}
+
+int group_cores(const CpuGroup& g) {
+    const int threads = static_cast<int>(g.cpus.size());
+    return g.cores > 0 ? std::min(g.cores, threads) : threads;
+}
+
+} // namespace
+
+ThreadPoolPlan recommend_thread_pools(const CpuTopology& topology, const HwFacts& hw) {
+    ThreadPoolPlan plan;
+
+    std::vector<CpuGroup> groups = topology.groups;
+    if (groups.empty()) {
+        CpuGroup g;
+        g.cores = hw.physical_cores > 0 ? hw.physical_cores : hw.logical_threads;
+        for (int c = 0; c < std::max(hw.logical_threads, 1); c++) g.cpus.push_back(c);
+        groups.push_back(std::move(g));
+    }
+
+    const bool hybrid = std::any_of(groups.begin(), groups.end(), is_efficiency) &&
+                        !std::all_of(groups.begin(), groups.end(), is_efficiency);
+    const int steal = hw.is_virtual_machine ? std::min<int>(hw.cpu_steal_percent, 100) : 0;
+
+    int threads = 0;
+    for (const CpuGroup& g : groups) {
+        CpuGroupPools pools;
+        pools.numa_node = g.numa_node;
+        pools.core_type = g.core_type;
+        pools.cpus = g.cpus;
+
+        const int cores = group_cores(g);
+        const int group_threads = static_cast<int>(g.cpus.size());
+        pools.sizes.compute = std::max(1, cores * (100 - steal) / 100);
+        pools.sizes.io = 2 * group_threads;
+        // Housekeeping goes to efficiency cores on hybrid parts.
+        if (!hybrid || is_efficiency(g)) {
+            pools.sizes.background = std::max(1, cores / (is_efficiency(g) ? 2 : 4));
+        }
+
+        threads += group_threads;
+        plan.groups.push_back(std::move(pools));
+    }
+
+    // Process-wide pools: compute on performance cores (efficiency cores too
+    // only when that is all there is), performance groups first.
+    std::stable_sort(plan.groups.begin(), plan.groups.end(), [](const CpuGroupPools& a, const CpuGroupPools& b) {
+        return (a.core_type == CoreType::Efficiency) < (b.core_type == CoreType::Efficiency);
+    });
+    for (const CpuGroupPools& g : plan.groups) {
+        if (hybrid && g.core_type == CoreType::Efficiency) continue;
+        plan.total.compute += g.sizes.compute;
+    }
+    for (const CpuGroupPools& g : plan.groups) plan.total.background += g.sizes.background;
+    if (topology.allowed_threads > 0) threads = std::min(threads, topology.allowed_threads);
+    plan.total.io = std::clamp(2 * threads, kMinIoThreads, kMaxIoThreads);
+    plan.total.background = std::max(plan.total.background, 1);
+
+    // A CFS quota throttles everything past it: cap compute at the quota and
+    // fill the groups in order; blocking I/O threads may exceed it somewhat.
+    const double quota = topology.cpu_quota;
+    if (quota > 0.0) {
+        const int cap = std::max(1, static_cast<int>(std::floor(quota)));
+        plan.total.compute = std::min(plan.total.compute, cap);
+        plan.total.io = std::min(plan.total.io, std::max(kMinIoThreads, static_cast<int>(std::ceil(4.0 * quota))));
+        plan.total.background = std::min(plan.total.background, std::max(1, cap / 4));
+
+        int left = cap;
+        for (CpuGroupPools& g : plan.groups) {
+            g.sizes.compute = std::min(g.sizes.compute, left);
+            left -= g.sizes.compute;
+            g.sizes.io = std::min(g.sizes.io, plan.total.io);
+            g.sizes.background = std::min(g.sizes.background, plan.total.background);
+        }
+    }
+    return plan;
+}
+
+ThreadPoolPlan recommend_thread_pools() {
+    return recommend_thread_pools(detect_cpu_topology(), detect_hw_facts());
+}
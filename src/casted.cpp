@@ -0,0 +1,217 @@
+// casted: answers caste queries from a detection done once per boot (and
+// again on hotplug) so short-lived processes skip NVML and /proc parsing.
+// Protocol: see "casted" in caste.hpp. The same facts are published to a
+// shared-memory segment for CasteShmReader.
+
+#include "caste.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kRefresh = std::chrono::milliseconds(5000); // RAM re-read interval (balloon drivers)
+constexpr auto kClientTimeout = std::chrono::milliseconds(100);
+constexpr size_t kMaxClients = 256; // beyond this the oldest pending client is dropped
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_signal(int) {
+    g_stop = 1;
+}
+
+int listen_on(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    ::unlink(path.c_str()); // stale socket from a previous run
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 128) != 0) {
+        const int err = errno;
+        ::close(fd);
+        errno = err;
+        return -1;
+    }
+    ::chmod(path.c_str(), 0666); // any local user may query
+    return fd;
+}
+
+// A connection waiting for its request. Clients are never waited on
+// individually; the main loop polls them alongside the listener.
+struct Client {
+    int fd = -1;
+    uint8_t request[kCastedRequestSize] = {};
+    size_t got = 0;
+    Clock::time_point deadline;
+};
+
+// Reads what the client has sent so far and answers once the request is
+// complete. True when the client is finished (answered, closed or invalid).
+bool serve(Client& c, const uint8_t record[kCastedRecordSize]) {
+    while (c.got < sizeof(c.request)) {
+        const ssize_t n = ::recv(c.fd, c.request + c.got, sizeof(c.request) - c.got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+        if (n <= 0) return true;
+        c.got += static_cast<size_t>(n);
+    }
+    const uint8_t* r = c.request;
+    if (r[0] == 'C' && r[1] == 'S' && r[2] == 'T' && r[3] == kCastedVersion && r[4] == kCastedOpFacts) {
+        // Fits in an empty socket buffer, so a nonblocking send never splits it.
+        ::send(c.fd, record, kCastedRecordSize, MSG_NOSIGNAL);
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string socket_path = kCastedSocketPath;
+    std::string shm_name;
+    if (const char* env = std::getenv("CASTE_SOCKET"); env && *env) socket_path = env;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg.rfind("--socket=", 0) == 0) {
+            socket_path = arg.substr(9);
+        } else if (arg == "--shm" && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if (arg.rfind("--shm=", 0) == 0) {
+            shm_name = arg.substr(6);
+        } else if (arg == "--version") {
+            std::cout << "casted " << CASTE_VERSION << "\n";
+            return 0;
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: casted [--socket PATH] [--shm NAME]\n"
+                         "  Serves hardware facts to caste clients over a Unix socket.\n"
+                         "  --socket PATH Listen on PATH (default $CASTE_SOCKET or " << kCastedSocketPath << ").\n"
+                         "  --shm NAME Publish to shared memory NAME (default $CASTE_SHM or " << kCasteShmName << ").\n"
+                         "  --version Show version.\n"
+                         "  -h, --help Show this help.\n";
+            return 0;
+        } else {
+            std::cerr << "casted: unknown option '" << arg << "'\n";
+            return 1;
+        }
+    }
+
+    const int listener = listen_on(socket_path);
+    if (listener < 0) {
+        std::cerr << "casted: " << socket_path << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    struct sigaction sa{};
+    sa.sa_handler = on_signal;
+    std::signal(SIGPIPE, SIG_IGN);
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+
+    HwWatcher watcher;
+    uint32_t generation = 1;
+    uint8_t record[kCastedRecordSize];
+    encode_casted_record(watcher.facts(), generation, record);
+
+    // Same facts for in-process readers (CasteShmReader); best effort.
+    CasteShmPublisher shm(shm_name.empty() ? nullptr : shm_name.c_str());
+    shm.publish(watcher.facts(), watcher.result());
+
+    std::vector<Client> clients;
+    std::vector<pollfd> fds;
+    Clock::time_point next_refresh = Clock::now() + kRefresh;
+
+    while (!g_stop) {
+        fds.clear();
+        fds.push_back({listener, POLLIN, 0});
+        fds.push_back({watcher.fd(), POLLIN, 0}); // poll() skips a negative fd
+        Clock::time_point wake = next_refresh;
+        for (const Client& c : clients) {
+            fds.push_back({c.fd, POLLIN, 0});
+            wake = std::min(wake, c.deadline);
+        }
+        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(wake - Clock::now()).count();
+        const int ready = ::poll(fds.data(), fds.size(), static_cast<int>(std::max<long long>(wait, 0)));
+        if (ready < 0 && errno != EINTR) break;
+        const Clock::time_point now = Clock::now();
+
+        // On schedule even when a steady stream of clients keeps poll() busy.
+        if (now >= next_refresh || (ready > 0 && (fds[1].revents & POLLIN))) {
+            watcher.poll(0);
+            next_refresh = now + kRefresh;
+            uint8_t fresh[kCastedRecordSize];
+            encode_casted_record(watcher.facts(), generation, fresh);
+            if (std::memcmp(fresh, record, kCastedRecordSize) != 0) {
+                encode_casted_record(watcher.facts(), ++generation, record);
+                shm.publish(watcher.facts(), watcher.result());
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < clients.size(); ++i) {
+            Client& c = clients[i];
+            const bool done = (ready > 0 && fds[i + 2].revents && serve(c, record)) || now >= c.deadline;
+            if (done) {
+                ::close(c.fd);
+            } else {
+                clients[kept++] = c;
+            }
+        }
+        clients.resize(kept);
+
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            for (;;) {
+                Client c;
+                c.fd = ::accept(listener, nullptr, nullptr);
+                if (c.fd < 0) break;
+                ::fcntl(c.fd, F_SETFD, FD_CLOEXEC);
+                ::fcntl(c.fd, F_SETFL, ::fcntl(c.fd, F_GETFL) | O_NONBLOCK);
+                c.deadline = now + kClientTimeout;
+                if (serve(c, record)) { // the request usually arrives with the connection
+                    ::close(c.fd);
+                    continue;
+                }
+                if (clients.size() >= kMaxClients) {
+                    ::close(clients.front().fd);
+                    clients.erase(clients.begin());
+                }
+                clients.push_back(c);
+            }
+        }
+    }
+
+    for (const Client& c : clients) ::close(c.fd);
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    return 0;
+}
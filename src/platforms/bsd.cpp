@@ -151,11 +151,6 @@ HwFacts fill_hw_facts_platform() {
 
     // GPU via pciconf
     auto gpus = parse_pciconf_gpus();
-    if (gpus.empty()) {
-        hw.gpu_kind = GpuKind::None;
-        return hw;
-    }
-
     for (auto& g : gpus) {
         std::string vendor = to_lower(g.vendor);
         std::string device = to_lower(g.device);
@@ -167,12 +162,19 @@ HwFacts fill_hw_facts_platform() {
             g.is_discrete_hint = true;
         } else if (vendor.find("intel") != std::string::npos) {
             g.is_discrete_hint = false;
+        } else {
+            g.is_gpu = false; // BMC or emulated display; see is_gpu_vendor()
         }
 
         if (device.find("arc") != std::string::npos) {
             g.is_intel_arc_hint = true;
         }
     }
+    std::erase_if(gpus, [](const GpuCandidate& g) { return !g.is_gpu; });
+    if (gpus.empty()) {
+        hw.gpu_kind = GpuKind::None;
+        return hw;
+    }
 
     GpuCandidate best = pick_best_gpu(gpus);
     hw.is_intel_arc = best.is_intel_arc_hint;
@@ -18,19 +18,36 @@
 #if defined(__linux__)
 
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <cstdlib>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <linux/netlink.h>
+#include <map>
+#include <mutex>
 #include <optional>
+#include <sched.h>
+#include <poll.h>
 #include <set>
 #include <sstream>
 #include <string>
+#include <sys/socket.h>
 #include <sys/sysinfo.h>
 #include <thread>
+#include <unistd.h>
 #include <utility>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
 namespace {
 
 static inline std::string trim(std::string s) {
@@ -264,14 +281,75 @@ static bool path_is_card(const std::filesystem::directory_entry& de) {
     return true;
 }
 
+struct PcieLink {
+    double current_speed_gts = 0.0;
+    int current_width = 0;
+    double max_speed_gts = 0.0;
+    int max_width = 0;
+};
+
 struct GpuCandidate {
     uint64_t vendor = 0;   // PCI vendor
     uint64_t device = 0;   // PCI device id
     bool is_discrete_hint = false;
     bool is_intel_arc_hint = false;
     uint64_t vram_bytes = 0; // best-effort
+    PcieLink link;
+    uint64_t host_to_device_bytes_per_sec = 0;
 };
 
+// e.g. "16.0 GT/s PCIe", "8 GT/s", "Unknown"
+static double read_link_speed_gts(const std::filesystem::path& p) {
+    auto txt = read_text_file(p);
+    if (!txt) return 0.0;
+    try {
+        return std::stod(trim(*txt));
+    } catch (...) {
+        return 0.0;
+    }
+}
+
+static int read_link_width(const std::filesystem::path& p) {
+    auto v = read_dec_u64_file(p);
+    if (!v || *v > 64) return 0;
+    return static_cast<int>(*v);
+}
+
+static PcieLink read_pcie_link(const std::filesystem::path& pci_dev) {
+    PcieLink link{};
+    link.current_speed_gts = read_link_speed_gts(pci_dev / "current_link_speed");
+    link.current_width = read_link_width(pci_dev / "current_link_width");
+    link.max_speed_gts = read_link_speed_gts(pci_dev / "max_link_speed");
+    link.max_width = read_link_width(pci_dev / "max_link_width");
+    return link;
+}
+
+// Walk from the GPU up through bridges/switches to the root port; the
+// narrowest hop bounds host-to-device copies. Width uses the negotiated
+// (current) value, which is what a x4 riser shows. Speed uses the lowest
+// max_link_speed along the path, because GPUs drop the current speed to
+// Gen1 while idle and would otherwise look like they sit on a slow link.
+static uint64_t estimate_host_to_device_bandwidth(const std::filesystem::path& pci_dev) {
+    std::error_code ec;
+    std::filesystem::path node = std::filesystem::canonical(pci_dev, ec);
+    if (ec) return 0;
+
+    double speed = 0.0;
+    int width = 0;
+    while (!node.empty() && node != node.root_path()) {
+        PcieLink hop = read_pcie_link(node);
+        if (hop.current_width <= 0 && hop.max_width <= 0) break; // left the PCIe hierarchy
+
+        double hop_speed = (hop.max_speed_gts > 0.0) ? hop.max_speed_gts : hop.current_speed_gts;
+        int hop_width = (hop.current_width > 0) ? hop.current_width : hop.max_width;
+        if (hop_speed > 0.0) speed = (speed > 0.0) ? std::min(speed, hop_speed) : hop_speed;
+        if (hop_width > 0) width = (width > 0) ? std::min(width, hop_width) : hop_width;
+
+        node = node.parent_path();
+    }
+    return pcie_link_bandwidth(speed, width);
+}
+
 static bool intel_arc_device_heuristic(uint64_t intel_device_id) {
     // Heuristic: DG2/Alchemist (Arc) devices commonly fall in 0x56xx / 0x57xx ranges.
     // This is not perfect, but good enough for a first-caste bucket.
@@ -304,6 +382,8 @@ static std::vector<GpuCandidate> enumerate_gpus_sysfs() {
         GpuCandidate g{};
         g.vendor = vendor;
         g.device = device;
+        g.link = read_pcie_link(devpath);
+        g.host_to_device_bytes_per_sec = estimate_host_to_device_bandwidth(devpath);
 
         // Vendor-based hints
         // NVIDIA: 0x10de
@@ -337,6 +417,20 @@ static bool has_vendor(const std::vector<GpuCandidate>& gpus, uint64_t vendor) {
     return std::any_of(gpus.begin(), gpus.end(), [&](const GpuCandidate& g){ return g.vendor == vendor; });
 }
 
+// NVIDIA VRAM via NVML (best effort) — if ANY NVIDIA present, we’ll try it.
+static void attach_nvidia_vram(std::vector<GpuCandidate>& gpus) {
+    if (!has_vendor(gpus, 0x10de)) return;
+    uint64_t nvidia_vram_best = query_nvidia_vram_bytes_nvml_best_effort();
+    if (nvidia_vram_best == 0) return;
+    // Attach this VRAM number to all NVIDIA candidates so picker can choose properly.
+    for (auto& g : gpus) {
+        if (g.vendor == 0x10de) {
+            g.vram_bytes = std::max(g.vram_bytes, nvidia_vram_best);
+            g.is_discrete_hint = true;
+        }
+    }
+}
+
 static GpuCandidate pick_best_gpu(std::vector<GpuCandidate> gpus) {
     // Prefer discrete > integrated, then by VRAM if known, else by vendor preference.
     // Vendor preference when unknown VRAM: NVIDIA > AMD > Intel.
@@ -358,46 +452,679 @@ static GpuCandidate pick_best_gpu(std::vector<GpuCandidate> gpus) {
                             });
 }
 
-} // namespace
+// ------------ Power supply via /sys/class/power_supply ------------
 
-HwFacts fill_hw_facts_platform() {
-    HwFacts hw{};
+static PowerProfile parse_platform_profile(const std::string& s) {
+    if (s == "low-power" || s == "quiet" || s == "cool") return PowerProfile::LowPower;
+    if (s == "balanced") return PowerProfile::Balanced;
+    if (s == "balanced-performance" || s == "performance") return PowerProfile::Performance;
+    return PowerProfile::Unknown;
+}
 
-    // RAM
-    hw.ram_bytes = get_total_ram_bytes_sysinfo();
+// ------------ Thermal zones, throttle counters, RAPL ------------
 
-    // CPU
-    {
-        CpuCounts c = get_cpu_counts_from_proc();
-        hw.logical_threads = c.logical_threads;
-        hw.physical_cores = c.physical_cores;
-        if (hw.logical_threads <= 0) hw.logical_threads = (int)std::thread::hardware_concurrency();
+static bool has_prefix(const std::string& s, const char* prefix) {
+    return s.rfind(prefix, 0) == 0;
+}
+
+static void read_thermal_zones(ThermalState& ts) {
+    std::error_code ec;
+    for (auto& de : std::filesystem::directory_iterator("/sys/class/thermal", ec)) {
+        const std::string name = de.path().filename().string();
+
+        if (has_prefix(name, "cooling_device")) {
+            auto type = read_text_file(de.path() / "type");
+            if (type && trim(*type) == "Fan") ts.has_fan = true;
+            continue;
+        }
+        if (!has_prefix(name, "thermal_zone")) continue;
+
+        auto milli = read_dec_u64_file(de.path() / "temp");
+        if (!milli || *milli == 0) continue; // absent or negative (stoull fails)
+        const double temp_c = static_cast<double>(*milli) / 1000.0;
+        ts.zone_count++;
+        ts.max_temp_c = std::max(ts.max_temp_c, temp_c);
+
+        // Lowest passive/hot/critical trip; "active" trips only spin fans.
+        double trip_c = -1.0;
+        for (int i = 0; i < 16; i++) {
+            auto type = read_text_file(de.path() / ("trip_point_" + std::to_string(i) + "_type"));
+            if (!type) break;
+            std::string t = trim(*type);
+            if (t != "passive" && t != "hot" && t != "critical") continue;
+            auto trip = read_dec_u64_file(de.path() / ("trip_point_" + std::to_string(i) + "_temp"));
+            if (!trip || *trip == 0) continue;
+            double c = static_cast<double>(*trip) / 1000.0;
+            if (trip_c < 0.0 || c < trip_c) trip_c = c;
+        }
+        if (trip_c > 0.0) {
+            double margin = std::max(0.0, trip_c - temp_c);
+            if (ts.min_trip_margin_c < 0.0 || margin < ts.min_trip_margin_c) ts.min_trip_margin_c = margin;
+        }
     }
 
-    // GPU(s)
-    auto gpus = enumerate_gpus_sysfs();
+    for (auto& de : std::filesystem::directory_iterator("/sys/class/hwmon", ec)) {
+        if (std::filesystem::exists(de.path() / "fan1_input")) ts.has_fan = true;
+    }
+}
+
+static void read_throttle_counters(ThermalState& ts) {
+    std::error_code ec;
+    for (auto& de : std::filesystem::directory_iterator("/sys/devices/system/cpu", ec)) {
+        const std::string name = de.path().filename().string();
+        if (!has_prefix(name, "cpu") || name.size() < 4 || name[3] < '0' || name[3] > '9') continue;
+        auto dir = de.path() / "thermal_throttle";
+        // Counters repeat across SMT siblings / package members, so keep the max.
+        ts.core_throttle_count = std::max(ts.core_throttle_count,
+                                          read_dec_u64_file(dir / "core_throttle_count").value_or(0));
+        ts.package_throttle_count = std::max(ts.package_throttle_count,
+                                             read_dec_u64_file(dir / "package_throttle_count").value_or(0));
+    }
+    // The counters run since boot.
+    if (auto uptime = read_text_file("/proc/uptime")) ts.throttle_window_s = std::strtod(uptime->c_str(), nullptr);
+}
+
+static void read_rapl_limits(ThermalState& ts) {
+    std::error_code ec;
+    for (auto& de : std::filesystem::directory_iterator("/sys/class/powercap", ec)) {
+        auto name = read_text_file(de.path() / "name");
+        if (!name || !has_prefix(trim(*name), "package")) continue;
+
+        for (int i = 0; i < 4; i++) {
+            const std::string prefix = "constraint_" + std::to_string(i) + "_";
+            auto cname = read_text_file(de.path() / (prefix + "name"));
+            if (!cname) break;
+            auto uw = read_dec_u64_file(de.path() / (prefix + "power_limit_uw"));
+            if (!uw || *uw == 0) continue;
+            const double watts = static_cast<double>(*uw) / 1e6;
+            const std::string c = trim(*cname);
+            if (c == "long_term") ts.rapl_long_term_watts = std::max(ts.rapl_long_term_watts, watts);
+            else if (c == "short_term") ts.rapl_short_term_watts = std::max(ts.rapl_short_term_watts, watts);
+        }
+    }
+}
+
+// ------------ Virtualization ------------
+
+static std::string hypervisor_from_signature(const std::string& sig) {
+    if (sig.rfind("KVMKVMKVM", 0) == 0) return "KVM";
+    if (sig == "Microsoft Hv") return "Hyper-V";
+    if (sig == "VMwareVMware") return "VMware";
+    if (sig == "XenVMMXenVMM") return "Xen";
+    if (sig == "VBoxVBoxVBox") return "VirtualBox";
+    if (sig == "TCGTCGTCGTCG") return "QEMU";
+    if (sig == " lrpepyh  vr") return "Parallels";
+    if (sig == "bhyve bhyve ") return "bhyve";
+    if (sig == "ACRNACRNACRN") return "ACRN";
+    return trim(sig);
+}
+
+// cpuid leaf 1 ECX bit 31 is reserved for hypervisors to announce themselves;
+// leaf 0x40000000 then carries a 12-byte vendor signature.
+static bool cpuid_hypervisor(std::string& vendor) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned a = 0, b = 0, c = 0, d = 0;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+    if (((c >> 31) & 1u) == 0) return false;
+    __cpuid(0x40000000, a, b, c, d);
+    char sig[13] = {};
+    std::memcpy(sig + 0, &b, 4);
+    std::memcpy(sig + 4, &c, 4);
+    std::memcpy(sig + 8, &d, 4);
+    vendor = hypervisor_from_signature(sig);
+    return true;
+#else
+    (void)vendor;
+    return false;
+#endif
+}
+
+static std::string dmi_hypervisor(const std::string& vendor, const std::string& product) {
+    auto has = [](const std::string& s, const char* needle) { return s.find(needle) != std::string::npos; };
+    if (has(product, "KVM") || has(vendor, "QEMU")) return "KVM";
+    if (has(product, "VMware")) return "VMware";
+    if (has(product, "VirtualBox")) return "VirtualBox";
+    if (has(vendor, "Microsoft") && has(product, "Virtual Machine")) return "Hyper-V";
+    if (has(product, "HVM domU")) return "Xen";
+    if (has(product, "Google Compute Engine")) return "GCE";
+    // EC2 bare-metal instances are named "*.metal".
+    if (has(vendor, "Amazon EC2") && !has(product, ".metal")) return "Nitro";
+    return {};
+}
+
+// Aggregate "cpu" line of /proc/stat:
+// cpu user nice system idle iowait irq softirq steal guest guest_nice
+struct CpuTicks {
+    uint64_t steal = 0;
+    uint64_t total = 0;
+    std::chrono::steady_clock::time_point at;
+};
+
+static std::optional<CpuTicks> read_cpu_ticks() {
+    std::ifstream f("/proc/stat");
+    std::string label;
+    uint64_t v[8] = {};
+    if (!(f >> label) || label != "cpu") return std::nullopt;
+    for (auto& x : v) {
+        if (!(f >> x)) return std::nullopt;
+    }
+    CpuTicks t;
+    for (auto x : v) t.total += x;
+    t.steal = v[7];
+    t.at = std::chrono::steady_clock::now();
+    return t;
+}
+
+// The ticks count in 1/100 s, so a shorter window is too coarse to use.
+static constexpr auto kStealWindow = std::chrono::milliseconds(200);
+
+// Share of CPU time stolen recently. The counters run since boot, so the
+// share is taken between two samples: the previous call's, if it is at
+// least kStealWindow old (HwWatcher refreshes reuse it), else a second one
+// kStealWindow after the first. A guest that has never had time stolen
+// returns 0 without waiting.
+static double read_steal_percent() {
+    static std::mutex mu;
+    static std::optional<CpuTicks> last;
+    static double last_percent = 0.0;
+    std::lock_guard<std::mutex> lock(mu);
+
+    auto now = read_cpu_ticks();
+    if (!now) return 0.0;
+    if (now->steal == 0) {
+        last = now;
+        return last_percent = 0.0;
+    }
+    if (last && now->at - last->at < kStealWindow) return last_percent;
+    if (!last) {
+        last = now;
+        std::this_thread::sleep_for(kStealWindow);
+        now = read_cpu_ticks();
+        if (!now) return 0.0;
+    }
+    const uint64_t total = now->total - last->total;
+    const uint64_t steal = now->steal - last->steal;
+    last = now;
+    last_percent = total == 0 ? 0.0 : 100.0 * static_cast<double>(steal) / static_cast<double>(total);
+    return last_percent;
+}
+
+static bool smt_siblings_visible() {
+    auto siblings = read_text_file("/sys/devices/system/cpu/cpu0/topology/thread_siblings_list");
+    if (!siblings) return false;
+    std::string s = trim(*siblings);
+    return s.find_first_of(",-") != std::string::npos;
+}
+
+// ------------ CPU topology (affinity, NUMA, hybrid cores, cgroup quota) ------------
+
+// "0-3,8,10-11" => {0,1,2,3,8,10,11}
+static std::vector<int> parse_cpu_list(const std::string& s) {
+    std::vector<int> out;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, ',')) {
+        part = trim(part);
+        if (part.empty()) continue;
+        int lo = 0, hi = 0;
+        if (std::sscanf(part.c_str(), "%d-%d", &lo, &hi) == 2) {
+            for (int c = lo; c <= hi; c++) out.push_back(c);
+        } else if (std::sscanf(part.c_str(), "%d", &lo) == 1) {
+            out.push_back(lo);
+        }
+    }
+    return out;
+}
+
+static std::vector<int> allowed_cpus() {
+    std::vector<int> out;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &set)) out.push_back(c);
+        }
+    }
+    return out;
+}
+
+static std::map<int, int> numa_node_of_cpus() {
+    std::map<int, int> out;
+    std::error_code ec;
+    for (const auto& de : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+        const std::string name = de.path().filename().string();
+        if (!has_prefix(name, "node")) continue;
+        const int node = std::atoi(name.c_str() + 4);
+        if (auto list = read_text_file(de.path() / "cpulist")) {
+            for (int c : parse_cpu_list(trim(*list))) out[c] = node;
+        }
+    }
+    return out;
+}
+
+// Intel hybrid parts list their P- and E-cores under separate PMUs; ARM
+// big.LITTLE reports a lower cpu_capacity for the little cores.
+static std::map<int, CoreType> core_types(const std::vector<int>& cpus) {
+    std::map<int, CoreType> out;
+    auto p_list = read_text_file("/sys/devices/cpu_core/cpus");
+    auto e_list = read_text_file("/sys/devices/cpu_atom/cpus");
+    if (p_list && e_list) {
+        for (int c : parse_cpu_list(trim(*p_list))) out[c] = CoreType::Performance;
+        for (int c : parse_cpu_list(trim(*e_list))) out[c] = CoreType::Efficiency;
+        return out;
+    }
+
+    std::map<int, uint64_t> capacity;
+    std::set<uint64_t> tiers;
+    for (int c : cpus) {
+        auto v = read_dec_u64_file("/sys/devices/system/cpu/cpu" + std::to_string(c) + "/cpu_capacity");
+        if (!v) return out;
+        capacity[c] = *v;
+        tiers.insert(*v);
+    }
+    if (tiers.size() < 2) return out;
+
+    // Three-tier parts (prime, big, little) split at the largest capacity
+    // gap, so the big cores stay with the prime ones rather than the little.
+    uint64_t threshold = 0, widest = 0;
+    for (auto lo = tiers.begin(), hi = std::next(lo); hi != tiers.end(); ++lo, ++hi) {
+        if (*hi - *lo > widest) {
+            widest = *hi - *lo;
+            threshold = *hi;
+        }
+    }
+    for (const auto& [c, v] : capacity) {
+        out[c] = v >= threshold ? CoreType::Performance : CoreType::Efficiency;
+    }
+    return out;
+}
+
+// cgroup v2 directory of this process, e.g. "/sys/fs/cgroup/user.slice/...".
+static std::optional<std::filesystem::path> cgroup_v2_dir() {
+    std::ifstream f("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (has_prefix(line, "0::")) {
+            std::filesystem::path dir = "/sys/fs/cgroup" + line.substr(3);
+            return dir.lexically_normal();
+        }
+    }
+    return std::nullopt;
+}
+
+// This process's cgroup v1 directories for a controller mounted at mount,
+// from its own group up to the hierarchy root. /proc/self/cgroup lines are
+// "ID:controller[,controller...]:/path". Inside a container without a cgroup
+// namespace that path is the host's and does not exist under the mount; the
+// walk then starts at the first ancestor that does.
+static std::vector<std::filesystem::path> cgroup_v1_dirs(const std::filesystem::path& mount, const char* controller) {
+    std::vector<std::filesystem::path> out;
+    std::ifstream f("/proc/self/cgroup");
+    std::string line;
+    std::string rel;
+    while (std::getline(f, line)) {
+        const size_t a = line.find(':');
+        const size_t b = a == std::string::npos ? a : line.find(':', a + 1);
+        if (b == std::string::npos) continue;
+        std::istringstream controllers(line.substr(a + 1, b - a - 1));
+        for (std::string c; std::getline(controllers, c, ',');) {
+            if (c == controller) rel = line.substr(b + 1);
+        }
+    }
+    std::filesystem::path p = (mount / std::filesystem::path(rel).relative_path()).lexically_normal();
+    for (;; p = p.parent_path()) {
+        if (std::filesystem::exists(p)) out.push_back(p);
+        if (p == mount || !p.has_relative_path()) break;
+    }
+    return out;
+}
+
+// Tightest "quota period" in cpu.max from this cgroup up to the root, or the
+// tightest v1 CFS quota on the same walk; 0 when unlimited.
+static double cgroup_cpu_quota() {
+    double quota = 0.0;
+    auto take = [&](double q) {
+        if (q > 0.0 && (quota == 0.0 || q < quota)) quota = q;
+    };
+
+    if (auto dir = cgroup_v2_dir()) {
+        for (std::filesystem::path p = *dir; ; p = p.parent_path()) {
+            if (auto txt = read_text_file(p / "cpu.max")) {
+                std::istringstream ss(*txt);
+                std::string max;
+                double period = 0.0;
+                if (ss >> max >> period && max != "max" && period > 0.0) {
+                    take(std::atof(max.c_str()) / period);
+                }
+            }
+            if (p == "/sys/fs/cgroup" || !p.has_relative_path()) break;
+        }
+    }
+
+    // v1: the same walk from this process's own cpu cgroup. Both mount names
+    // are tried; they are usually one directory and a symlink.
+    for (const char* mount : {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"}) {
+        for (const auto& dir : cgroup_v1_dirs(mount, "cpu")) {
+            auto q = read_text_file(dir / "cpu.cfs_quota_us");
+            auto period = read_dec_u64_file(dir / "cpu.cfs_period_us");
+            if (q && period && *period > 0) {
+                const double us = std::atof(trim(*q).c_str());
+                if (us > 0.0) take(us / static_cast<double>(*period));
+            }
+        }
+    }
+    return quota;
+}
+
+// ------------ Memory (MemAvailable, cgroup limits) ------------
+
+// "MemAvailable:   123456 kB" => bytes
+static uint64_t meminfo_bytes(const std::string& text, const char* key) {
+    const size_t pos = text.find(key);
+    if (pos == std::string::npos) return 0;
+    return std::strtoull(text.c_str() + pos + std::strlen(key), nullptr, 10) * 1024ull;
+}
+
+// Limits at or above this mean "unlimited" (cgroup v1 reports PAGE_COUNTER_MAX).
+static constexpr uint64_t kNoMemoryLimit = 1ull << 60;
+
+// A "key value" line of a cgroup memory.stat file; 0 if absent.
+static uint64_t memory_stat(const std::filesystem::path& dir, const char* key) {
+    const std::string text = read_text_file(dir / "memory.stat").value_or("");
+    std::istringstream ss(text);
+    std::string k;
+    uint64_t v = 0;
+    while (ss >> k >> v) {
+        if (k == key) return v;
+    }
+    return 0;
+}
+
+// Usage charged to a cgroup counts page cache. Inactive file pages are
+// reclaimed before the limit is enforced, so they are not subtracted from
+// what is left.
+static uint64_t working_set(uint64_t usage, uint64_t inactive_file) {
+    return usage > inactive_file ? usage - inactive_file : 0;
+}
 
-    // NVIDIA VRAM via NVML (best effort) — if ANY NVIDIA present, we’ll try it.
-    uint64_t nvidia_vram_best = 0;
-    if (has_vendor(gpus, 0x10de)) {
-        nvidia_vram_best = query_nvidia_vram_bytes_nvml_best_effort();
-        // Attach this VRAM number to all NVIDIA candidates so picker can choose properly.
-        if (nvidia_vram_best > 0) {
-            for (auto& g : gpus) {
-                if (g.vendor == 0x10de) {
-                    g.vram_bytes = std::max(g.vram_bytes, nvidia_vram_best);
-                    g.is_discrete_hint = true;
+static void read_cgroup_memory(MemoryFacts& mem) {
+    // The tightest memory.max up the tree; usage is charged to that cgroup.
+    if (auto dir = cgroup_v2_dir()) {
+        std::filesystem::path limited;
+        for (std::filesystem::path p = *dir; ; p = p.parent_path()) {
+            if (auto txt = read_text_file(p / "memory.max")) {
+                const std::string v = trim(*txt);
+                const uint64_t limit = v == "max" ? 0 : std::strtoull(v.c_str(), nullptr, 10);
+                if (limit > 0 && (mem.cgroup_limit_bytes == 0 || limit < mem.cgroup_limit_bytes)) {
+                    mem.cgroup_limit_bytes = limit;
+                    limited = p;
                 }
             }
+            if (p == "/sys/fs/cgroup" || !p.has_relative_path()) break;
+        }
+        if (mem.cgroup_limit_bytes) {
+            mem.cgroup_usage_bytes = working_set(read_dec_u64_file(limited / "memory.current").value_or(0),
+                                                 memory_stat(limited, "inactive_file"));
+            return;
+        }
+    }
+
+    // v1: the same walk from this process's own memory cgroup.
+    std::filesystem::path limited;
+    for (const auto& p : cgroup_v1_dirs("/sys/fs/cgroup/memory", "memory")) {
+        auto limit = read_dec_u64_file(p / "memory.limit_in_bytes");
+        if (limit && *limit > 0 && *limit < kNoMemoryLimit &&
+            (mem.cgroup_limit_bytes == 0 || *limit < mem.cgroup_limit_bytes)) {
+            mem.cgroup_limit_bytes = *limit;
+            limited = p;
         }
     }
+    if (mem.cgroup_limit_bytes) {
+        // total_ includes child groups, as usage_in_bytes does.
+        mem.cgroup_usage_bytes = working_set(read_dec_u64_file(limited / "memory.usage_in_bytes").value_or(0),
+                                             memory_stat(limited, "total_inactive_file"));
+    }
+}
+
+// ------------ Hotplug (kernel uevents) ------------
+
+// A uevent is "ACTION@DEVPATH" followed by NUL-separated KEY=VALUE pairs.
+// Map its SUBSYSTEM to the probes that can see the change.
+static uint8_t uevent_probes(const char* msg, size_t len) {
+    for (size_t i = 0; i < len; i += std::strlen(msg + i) + 1) {
+        const char* kv = msg + i;
+        if (std::strncmp(kv, "SUBSYSTEM=", 10) != 0) continue;
+        const char* sub = kv + 10;
+        if (std::strcmp(sub, "memory") == 0) return static_cast<uint8_t>(HwProbe::Memory);
+        if (std::strcmp(sub, "cpu") == 0) return static_cast<uint8_t>(HwProbe::Cpu);
+        if (std::strcmp(sub, "pci") == 0 || std::strcmp(sub, "drm") == 0 ||
+            std::strcmp(sub, "thunderbolt") == 0) {
+            return static_cast<uint8_t>(HwProbe::Gpu);
+        }
+        return 0;
+    }
+    return 0;
+}
+
+// ------------ Live load (PSI, loadavg) ------------
+//
+// These run on scheduler ticks, so: one read() per file into a stack
+// buffer and no std::string / iostreams.
+
+static int read_small_file(const char* path, char* buf, size_t cap) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = ::read(fd, buf, cap - 1);
+    ::close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return static_cast<int>(n);
+}
+
+// Finds "<line> avg10=<float>" in a /proc/pressure file.
+static float psi_avg10(const char* text, const char* line) {
+    const char* p = std::strstr(text, line);
+    if (!p) return 0.0f;
+    p = std::strstr(p, "avg10=");
+    if (!p) return 0.0f;
+    return std::strtof(p + 6, nullptr);
+}
+
+} // namespace
+
+LoadSample sample_load_platform() {
+    LoadSample s{};
+    char buf[256];
+
+    if (read_small_file("/proc/pressure/cpu", buf, sizeof(buf)) > 0) {
+        s.psi_available = true;
+        s.cpu_some = psi_avg10(buf, "some");
+    }
+    if (read_small_file("/proc/pressure/memory", buf, sizeof(buf)) > 0) {
+        s.memory_some = psi_avg10(buf, "some");
+        s.memory_full = psi_avg10(buf, "full");
+    }
+    if (read_small_file("/proc/pressure/io", buf, sizeof(buf)) > 0) {
+        s.io_some = psi_avg10(buf, "some");
+        s.io_full = psi_avg10(buf, "full");
+    }
+    if (read_small_file("/proc/loadavg", buf, sizeof(buf)) > 0) {
+        s.loadavg_1min = std::strtof(buf, nullptr);
+    }
+    return s;
+}
+
+VirtInfo detect_virtualization_platform() {
+    VirtInfo vi{};
+
+    std::string vendor;
+    if (cpuid_hypervisor(vendor)) {
+        vi.is_virtual_machine = true;
+        vi.hypervisor = vendor;
+    }
+
+    if (auto type = read_text_file("/sys/hypervisor/type")) {
+        std::string t = trim(*type);
+        if (!t.empty()) {
+            vi.is_virtual_machine = true;
+            if (vi.hypervisor.empty()) vi.hypervisor = (t == "xen") ? "Xen" : t;
+        }
+    }
+
+    const std::string dmi_vendor = trim(read_text_file("/sys/class/dmi/id/sys_vendor").value_or(""));
+    vi.product = trim(read_text_file("/sys/class/dmi/id/product_name").value_or(""));
+    std::string from_dmi = dmi_hypervisor(dmi_vendor, vi.product);
+    if (!from_dmi.empty()) {
+        vi.is_virtual_machine = true;
+        if (vi.hypervisor.empty()) vi.hypervisor = from_dmi;
+    }
+
+    vi.smt_exposed = smt_siblings_visible();
+    vi.steal_percent = read_steal_percent();
+    return vi;
+}
+
+ThermalState detect_thermal_state_platform() {
+    ThermalState ts{};
+    read_thermal_zones(ts);
+    read_throttle_counters(ts);
+    read_rapl_limits(ts);
+    return ts;
+}
+
+PowerState detect_power_state_platform() {
+    PowerState ps{};
+
+    bool saw_mains = false;
+    bool mains_online = false;
+    bool discharging = false;
+    int percent_sum = 0;
+    int percent_count = 0;
+
+    const std::filesystem::path root("/sys/class/power_supply");
+    std::error_code ec;
+    for (auto& de : std::filesystem::directory_iterator(root, ec)) {
+        auto type = read_text_file(de.path() / "type");
+        if (!type) continue;
+        std::string t = trim(*type);
+
+        if (t == "Mains" || t == "USB") {
+            saw_mains = true;
+            if (read_dec_u64_file(de.path() / "online").value_or(0) == 1) mains_online = true;
+        } else if (t == "Battery") {
+            // Skip peripheral batteries (mice, headsets) that report scope=Device.
+            auto scope = read_text_file(de.path() / "scope");
+            if (scope && trim(*scope) == "Device") continue;
+
+            ps.has_battery = true;
+            auto status = read_text_file(de.path() / "status");
+            if (status && trim(*status) == "Discharging") discharging = true;
+            if (auto cap = read_dec_u64_file(de.path() / "capacity")) {
+                percent_sum += static_cast<int>(std::min<uint64_t>(*cap, 100));
+                percent_count++;
+            }
+        }
+    }
+
+    if (ps.has_battery) {
+        // Some laptops expose no Mains supply at all; fall back to battery status.
+        ps.on_ac = saw_mains ? mains_online : !discharging;
+        if (percent_count > 0) ps.battery_percent = percent_sum / percent_count;
+    }
+
+    if (auto profile = read_text_file("/sys/firmware/acpi/platform_profile")) {
+        ps.profile = parse_platform_profile(trim(*profile));
+    }
+
+    return ps;
+}
+
+CpuTopology detect_cpu_topology_platform() {
+    CpuTopology topo;
+    std::vector<int> cpus = allowed_cpus();
+    if (cpus.empty()) {
+        const int n = static_cast<int>(std::thread::hardware_concurrency());
+        for (int c = 0; c < n; c++) cpus.push_back(c);
+    }
+    topo.allowed_threads = static_cast<int>(cpus.size());
+    topo.cpu_quota = cgroup_cpu_quota();
+
+    const std::map<int, int> nodes = numa_node_of_cpus();
+    const std::map<int, CoreType> types = core_types(cpus);
+
+    struct Key {
+        int node;
+        CoreType type;
+        bool operator<(const Key& o) const {
+            return node != o.node ? node < o.node : static_cast<int>(type) < static_cast<int>(o.type);
+        }
+    };
+    std::map<Key, CpuGroup> groups;
+    std::map<Key, std::set<std::pair<uint64_t, uint64_t>>> cores;
+    for (int c : cpus) {
+        auto node = nodes.find(c);
+        auto type = types.find(c);
+        const Key key{node != nodes.end() ? node->second : 0,
+                      type != types.end() ? type->second : CoreType::Unknown};
+        CpuGroup& g = groups[key];
+        g.numa_node = key.node;
+        g.core_type = key.type;
+        g.cpus.push_back(c);
+
+        const std::string topo_dir = "/sys/devices/system/cpu/cpu" + std::to_string(c) + "/topology/";
+        auto package = read_dec_u64_file(topo_dir + "physical_package_id");
+        auto core = read_dec_u64_file(topo_dir + "core_id");
+        // Without topology files every CPU counts as its own core.
+        cores[key].emplace(package.value_or(0), core ? *core : 0x100000000ull + static_cast<uint64_t>(c));
+    }
+    for (auto& [key, g] : groups) {
+        g.cores = static_cast<int>(cores[key].size());
+        topo.groups.push_back(std::move(g));
+    }
+    return topo;
+}
+
+MemoryFacts detect_memory_facts_platform() {
+    MemoryFacts mem;
+    if (auto txt = read_text_file("/proc/meminfo")) {
+        mem.total_bytes = meminfo_bytes(*txt, "MemTotal:");
+        mem.available_bytes = meminfo_bytes(*txt, "MemAvailable:");
+    }
+    if (mem.total_bytes == 0) mem.total_bytes = get_total_ram_bytes_sysinfo();
+    read_cgroup_memory(mem);
+    return mem;
+}
+
+static void fill_memory_facts(HwFacts& hw) {
+    hw.ram_bytes = get_total_ram_bytes_sysinfo();
+}
+
+static void fill_cpu_facts(HwFacts& hw) {
+    CpuCounts c = get_cpu_counts_from_proc();
+    hw.logical_threads = c.logical_threads;
+    hw.physical_cores = c.physical_cores;
+    if (hw.logical_threads <= 0) hw.logical_threads = (int)std::thread::hardware_concurrency();
+
+    // Virtualization
+    VirtInfo vi = detect_virtualization_platform();
+    hw.is_virtual_machine = vi.is_virtual_machine;
+    hw.cpu_steal_percent = static_cast<uint8_t>(std::min(100.0, vi.steal_percent + 0.5));
+}
+
+static void fill_gpu_facts(HwFacts& hw) {
+    auto gpus = enumerate_gpus_sysfs();
+
+    attach_nvidia_vram(gpus);
+    std::erase_if(gpus, [](const GpuCandidate& g) {
+        return !g.is_discrete_hint && !is_gpu_vendor(static_cast<uint32_t>(g.vendor));
+    });
 
     if (gpus.empty()) {
         hw.gpu_kind = GpuKind::None;
         hw.has_discrete_gpu = false;
         hw.vram_bytes = 0;
         hw.is_intel_arc = false;
-        return hw;
+        return;
     }
 
     GpuCandidate best = pick_best_gpu(std::move(gpus));
@@ -414,10 +1141,90 @@ HwFacts fill_hw_facts_platform() {
         hw.has_discrete_gpu = false;
         hw.vram_bytes = 0; // shared memory; don’t pretend
     }
+}
 
+void refresh_hw_facts_platform(HwFacts& hw, uint8_t probes) {
+    if (probes & static_cast<uint8_t>(HwProbe::Memory)) fill_memory_facts(hw);
+    if (probes & static_cast<uint8_t>(HwProbe::Cpu)) fill_cpu_facts(hw);
+    if (probes & static_cast<uint8_t>(HwProbe::Gpu)) fill_gpu_facts(hw);
+}
+
+HwFacts fill_hw_facts_platform() {
+    HwFacts hw{};
+    refresh_hw_facts_platform(hw, kAllHwProbes);
     return hw;
 }
 
+static constexpr int kUeventRecvBufferBytes = 1 << 20;
+
+int open_hw_events_platform() {
+    int fd = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) return -1;
+    // A hotplug burst (a dock, a GPU reset) can overflow the default
+    // buffer. Best effort: the forced size needs CAP_NET_ADMIN, the plain
+    // one is capped by net.core.rmem_max.
+    const int rcvbuf = kUeventRecvBufferBytes;
+    if (::setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0) {
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1; // kernel uevents (udev rebroadcasts on group 2)
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+uint8_t read_hw_events_platform(int fd, int timeout_ms) {
+    pollfd pfd{fd, POLLIN, 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0) return 0;
+
+    uint8_t probes = 0;
+    char buf[8192];
+    for (;;) {
+        const ssize_t n = ::recv(fd, buf, sizeof(buf) - 1, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == ENOBUFS) {
+            // Events were dropped; which devices changed is unknown.
+            probes = kAllHwProbes;
+            continue;
+        }
+        if (n <= 0) break;
+        buf[n] = '\0';
+        probes |= uevent_probes(buf, static_cast<size_t>(n));
+    }
+    return probes;
+}
+
+void close_hw_events_platform(int fd) {
+    if (fd >= 0) ::close(fd);
+}
+
+std::vector<GpuInfo> detect_gpus_platform() {
+    auto gpus = enumerate_gpus_sysfs();
+    attach_nvidia_vram(gpus);
+
+    std::vector<GpuInfo> out;
+    out.reserve(gpus.size());
+    for (const auto& g : gpus) {
+        GpuInfo info{};
+        info.vendor_id = static_cast<uint32_t>(g.vendor);
+        info.device_id = static_cast<uint32_t>(g.device);
+        info.kind = g.is_discrete_hint ? GpuKind::Discrete : GpuKind::Integrated;
+        info.vram_bytes = g.is_discrete_hint ? g.vram_bytes : 0;
+        info.is_intel_arc = (g.vendor == 0x8086) && g.is_intel_arc_hint;
+        info.pcie_current_speed_gts = g.link.current_speed_gts;
+        info.pcie_current_width = g.link.current_width;
+        info.pcie_max_speed_gts = g.link.max_speed_gts;
+        info.pcie_max_width = g.link.max_width;
+        info.host_to_device_bytes_per_sec = g.host_to_device_bytes_per_sec;
+        out.push_back(info);
+    }
+    return out;
+}
+
 // If you want a quick manual test, compile with -DHWFACTS_TEST_MAIN
 #ifdef HWFACTS_TEST_MAIN
 #include <iostream>
@@ -166,6 +166,20 @@ static std::vector<GpuCandidate> enumerate_gpus_iokit() {
 
 } // namespace
 
+VirtInfo detect_virtualization_platform() {
+    VirtInfo vi{};
+    bool vmm = false;
+    if (sysctl_bool("kern.hv_vmm_present", vmm) && vmm) {
+        vi.is_virtual_machine = true;
+        vi.hypervisor = "Hypervisor.framework";
+    }
+    int cores = 0, threads = 0;
+    sysctl_int("hw.physicalcpu", cores);
+    sysctl_int("hw.logicalcpu", threads);
+    vi.smt_exposed = cores > 0 && cores < threads;
+    return vi;
+}
+
 HwFacts fill_hw_facts_platform() {
     HwFacts hw{};
 
@@ -177,6 +191,7 @@ HwFacts fill_hw_facts_platform() {
     sysctl_int("hw.physicalcpu", hw.physical_cores);
     if (hw.logical_threads <= 0) sysctl_int("hw.logicalcpu_max", hw.logical_threads);
     if (hw.physical_cores <= 0) sysctl_int("hw.physicalcpu_max", hw.physical_cores);
+    hw.is_virtual_machine = detect_virtualization_platform().is_virtual_machine;
 
     // Apple Silicon detection
     bool arm64 = false;
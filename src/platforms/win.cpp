@@ -6,8 +6,13 @@
 #include <cstdint>
 #include <vector>
 
+#include <cstring>
+#include <string>
+
 #include <windows.h>
 #include <dxgi.h>
+#include <intrin.h>
+#include <psapi.h>
 
 namespace {
 
@@ -117,8 +122,53 @@ static std::vector<GpuCandidate> enumerate_gpus_dxgi() {
     return out;
 }
 
+// cpuid leaf 1 ECX bit 31 = running under a hypervisor; leaf 0x40000000 = vendor.
+static bool cpuid_hypervisor(std::string& vendor) {
+#if defined(_M_X64) || defined(_M_IX86)
+    int regs[4] = {};
+    __cpuid(regs, 1);
+    if ((static_cast<unsigned>(regs[2]) >> 31) == 0) return false;
+    __cpuid(regs, 0x40000000);
+    char sig[13] = {};
+    std::memcpy(sig + 0, &regs[1], 4);
+    std::memcpy(sig + 4, &regs[2], 4);
+    std::memcpy(sig + 8, &regs[3], 4);
+    vendor = sig;
+    if (vendor == "Microsoft Hv") vendor = "Hyper-V";
+    else if (vendor.rfind("KVMKVMKVM", 0) == 0) vendor = "KVM";
+    else if (vendor == "VMwareVMware") vendor = "VMware";
+    else if (vendor == "XenVMMXenVMM") vendor = "Xen";
+    else if (vendor == "VBoxVBoxVBox") vendor = "VirtualBox";
+    return true;
+#else
+    (void)vendor;
+    return false;
+#endif
+}
+
 } // namespace
 
+VirtInfo detect_virtualization_platform() {
+    VirtInfo vi{};
+    vi.is_virtual_machine = cpuid_hypervisor(vi.hypervisor);
+    // A Windows host with VBS/Hyper-V enabled also runs under "Microsoft Hv";
+    // only treat it as a guest when the root partition flag is absent
+    // (leaf 0x40000003 EBX bit 0 = CreatePartitions, set on the root).
+#if defined(_M_X64) || defined(_M_IX86)
+    if (vi.is_virtual_machine && vi.hypervisor == "Hyper-V") {
+        int regs[4] = {};
+        __cpuid(regs, 0x40000003);
+        if (regs[1] & 1) {
+            vi.is_virtual_machine = false;
+            vi.hypervisor.clear();
+        }
+    }
+#endif
+    CpuCounts c = get_cpu_counts();
+    vi.smt_exposed = c.physical_cores > 0 && c.physical_cores < c.logical_threads;
+    return vi;
+}
+
 HwFacts fill_hw_facts_platform() {
     HwFacts hw{};
 
@@ -133,9 +183,11 @@ HwFacts fill_hw_facts_platform() {
     CpuCounts c = get_cpu_counts();
     hw.logical_threads = c.logical_threads;
     hw.physical_cores = c.physical_cores;
+    hw.is_virtual_machine = detect_virtualization_platform().is_virtual_machine;
 
     // GPU
     auto gpus = enumerate_gpus_dxgi();
+    std::erase_if(gpus, [](const GpuCandidate& g) { return !g.is_discrete_hint && !is_gpu_vendor(g.vendor_id); });
     if (gpus.empty()) {
         hw.gpu_kind = GpuKind::None;
         return hw;
@@ -157,4 +209,60 @@ HwFacts fill_hw_facts_platform() {
     return hw;
 }
 
+MemoryFacts detect_memory_facts_platform() {
+    MemoryFacts mem;
+    MEMORYSTATUSEX ms{};
+    ms.dwLength = sizeof(ms);
+    if (GlobalMemoryStatusEx(&ms)) {
+        mem.total_bytes = static_cast<uint64_t>(ms.ullTotalPhys);
+        mem.available_bytes = static_cast<uint64_t>(ms.ullAvailPhys);
+    }
+
+    // Job objects are the Windows equivalent of a cgroup memory limit.
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION job{};
+    if (QueryInformationJobObject(nullptr, JobObjectExtendedLimitInformation, &job, sizeof(job), nullptr)) {
+        const DWORD flags = job.BasicLimitInformation.LimitFlags;
+        uint64_t limit = 0;
+        bool per_process = false;
+        if (flags & JOB_OBJECT_LIMIT_JOB_MEMORY) limit = static_cast<uint64_t>(job.JobMemoryLimit);
+        if ((flags & JOB_OBJECT_LIMIT_PROCESS_MEMORY) && (limit == 0 || job.ProcessMemoryLimit < limit)) {
+            limit = static_cast<uint64_t>(job.ProcessMemoryLimit);
+            per_process = true;
+        }
+        if (limit) {
+            mem.cgroup_limit_bytes = limit;
+            // Current usage of whatever the limit applies to (Peak* fields are high-water marks).
+            if (per_process) {
+                PROCESS_MEMORY_COUNTERS pmc{};
+                if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+                    mem.cgroup_usage_bytes = static_cast<uint64_t>(pmc.PagefileUsage);
+                }
+            } else {
+                JOBOBJECT_MEMORY_USAGE_INFORMATION usage{};
+                if (QueryInformationJobObject(nullptr, JobObjectMemoryUsageInformation, &usage, sizeof(usage),
+                                              nullptr)) {
+                    mem.cgroup_usage_bytes = static_cast<uint64_t>(usage.JobMemory);
+                }
+            }
+        }
+    }
+    return mem;
+}
+
+PowerState detect_power_state_platform() {
+    PowerState ps{};
+    SYSTEM_POWER_STATUS sps{};
+    if (!GetSystemPowerStatus(&sps)) return ps;
+
+    // BatteryFlag 128 = no system battery, 255 = unknown.
+    ps.has_battery = (sps.BatteryFlag != 128 && sps.BatteryFlag != 255);
+    if (ps.has_battery) {
+        ps.on_ac = (sps.ACLineStatus != 0);
+        if (sps.BatteryLifePercent <= 100) ps.battery_percent = sps.BatteryLifePercent;
+    }
+    // SystemStatusFlag is set while battery saver is on (Windows 10+).
+    if (sps.SystemStatusFlag == 1) ps.profile = PowerProfile::LowPower;
+    return ps;
+}
+
 #endif
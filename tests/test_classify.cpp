@@ -1,9 +1,21 @@
 #include "caste.hpp"
 
+#include <atomic>
 #include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <catch2/catch_test_macros.hpp>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 namespace {
 
 constexpr uint64_t GiB(uint64_t x) {
@@ -66,6 +78,944 @@ TEST_CASE("CPU caps are gentle and do not drop below User with enough RAM") {
     REQUIRE(classify_caste(hw).caste == Caste::User);
 }
 
+TEST_CASE("PCIe bandwidth estimate accounts for encoding and width") {
+    REQUIRE(pcie_link_bandwidth(0.0, 16) == 0);
+    REQUIRE(pcie_link_bandwidth(16.0, 0) == 0);
+
+    // Gen1 x1: 2.5 GT/s with 8b/10b => 250 MB/s
+    REQUIRE(pcie_link_bandwidth(2.5, 1) == 250'000'000ull);
+
+    // Gen3 x16 ~ 15.75 GB/s; a x4 riser is a quarter of that.
+    uint64_t x16 = pcie_link_bandwidth(8.0, 16);
+    REQUIRE(x16 > 15'700'000'000ull);
+    REQUIRE(x16 < 15'800'000'000ull);
+    REQUIRE(pcie_link_bandwidth(8.0, 4) == x16 / 4);
+
+    REQUIRE(pcie_link_bandwidth(16.0, 16) > x16);
+}
+
+namespace {
+constexpr HwFacts constexpr_hw(uint64_t ram, uint64_t vram, int cores, int threads) {
+    HwFacts hw{};
+    hw.ram_bytes = ram;
+    hw.vram_bytes = vram;
+    hw.physical_cores = cores;
+    hw.logical_threads = threads;
+    hw.gpu_kind = GpuKind::Discrete;
+    hw.has_discrete_gpu = true;
+    return hw;
+}
+} // namespace
+
+TEST_CASE("Classification is usable at compile time") {
+    STATIC_REQUIRE(classify_caste(constexpr_hw(GiB(64), GiB(24), 8, 16)).caste == Caste::Rig);
+    STATIC_REQUIRE(classify_caste(constexpr_hw(GiB(16), GiB(24), 8, 16)).caste == Caste::User);
+    STATIC_REQUIRE(classify_caste(constexpr_hw(GiB(4), 0, 2, 4)).caste == Caste::Mini);
+    STATIC_REQUIRE(classify_caste(constexpr_hw(GiB(16), GiB(24), 8, 16)).reasons.has(CasteRule::RamCap));
+    STATIC_REQUIRE(policy_is_monotonic(kDefaultCastePolicy));
+}
+
+TEST_CASE("Capability score ranks hosts within a caste") {
+    HwFacts small = base_hw();
+    small.vram_bytes = GiB(6);
+    HwFacts large = small;
+    large.vram_bytes = GiB(11);
+    large.physical_cores = 16;
+
+    CasteResult a = classify_caste(small);
+    CasteResult b = classify_caste(large);
+    REQUIRE(a.caste == Caste::Developer);
+    REQUIRE(b.caste == Caste::Developer);
+    REQUIRE(b.score > a.score);
+    REQUIRE(b.gpu_score > a.gpu_score);
+    REQUIRE(b.cpu_score > a.cpu_score);
+    REQUIRE(a.score >= 200.0);
+    REQUIRE(b.score < 300.0);
+
+    // Scores never decrease as RAM grows, across caste boundaries too.
+    double prev = -1.0;
+    for (uint64_t ram = GiB(1); ram <= GiB(512); ram += GiB(1)) {
+        HwFacts hw = base_hw();
+        hw.ram_bytes = ram;
+        hw.vram_bytes = GiB(24);
+        CasteResult r = classify_caste(hw);
+        REQUIRE(r.score >= prev);
+        REQUIRE(r.score >= 100.0 * static_cast<int>(r.caste));
+        REQUIRE(r.score < 100.0 * (static_cast<int>(r.caste) + 1));
+        prev = r.score;
+    }
+
+    STATIC_REQUIRE(classify_caste(constexpr_hw(GiB(64), GiB(24), 8, 16)).score >= 400.0);
+    STATIC_REQUIRE(caste_detail::table_position(kDefaultCastePolicy.vram_min, GiB(4)) == 1.5);
+}
+
+TEST_CASE("Workload profiles rank by the resource that limits them") {
+    // Many-core server, no GPU: Mini for local LLMs' VRAM model, strong for builds.
+    HwFacts server{};
+    server.ram_bytes = GiB(128);
+    server.physical_cores = 32;
+    server.logical_threads = 64;
+    server.gpu_kind = GpuKind::None;
+
+    REQUIRE(classify_workload(server, Workload::LlmInference).caste == classify_caste(server).caste);
+    CasteResult build = classify_workload(server, Workload::Compile);
+    REQUIRE(build.caste == Caste::Rig);
+    REQUIRE(build.reasons.has(CasteRule::BaseCpuCores));
+    REQUIRE(caste_reason_text(build).rfind("CPU core count caste", 0) == 0);
+    REQUIRE(classify_workload(server, Workload::Training).caste == Caste::User);
+
+    // Gaming laptop: big GPU, 8 cores, 16GiB RAM.
+    HwFacts laptop = base_hw();
+    laptop.ram_bytes = GiB(16);
+    laptop.vram_bytes = GiB(16);
+    REQUIRE(classify_workload(laptop, Workload::Compile).caste == Caste::Developer);
+    CasteResult video = classify_workload(laptop, Workload::VideoTranscode);
+    REQUIRE(video.reasons.has(CasteRule::MediaEngineBump));
+    REQUIRE(video.caste == Caste::Workstation);
+
+    // BMC-only server: the ASPEED console adapter is not a GPU, so HwFacts
+    // says None and there is no encoder bump. An Intel iGPU gets one.
+    REQUIRE_FALSE(is_gpu_vendor(0x1a03)); // ASPEED
+    REQUIRE_FALSE(is_gpu_vendor(0x102b)); // Matrox
+    REQUIRE(is_gpu_vendor(0x8086));
+    HwFacts bmc{};
+    bmc.ram_bytes = GiB(32);
+    bmc.physical_cores = 8;
+    bmc.logical_threads = 16;
+    CasteResult bmc_video = classify_workload(bmc, Workload::VideoTranscode);
+    REQUIRE_FALSE(bmc_video.reasons.has(CasteRule::MediaEngineBump));
+    REQUIRE(bmc_video.caste == Caste::Developer);
+    HwFacts igpu = bmc;
+    igpu.gpu_kind = GpuKind::Integrated;
+    REQUIRE(classify_workload(igpu, Workload::VideoTranscode).reasons.has(CasteRule::MediaEngineBump));
+
+    Workload w;
+    REQUIRE(parse_workload("video_transcode", w));
+    REQUIRE(w == Workload::VideoTranscode);
+    REQUIRE_FALSE(parse_workload("gaming", w));
+    STATIC_REQUIRE(classify_workload(constexpr_hw(GiB(64), GiB(24), 8, 16), Workload::Training).caste ==
+                   Caste::Workstation);
+}
+
+TEST_CASE("LLM plans fit models to VRAM and host RAM") {
+    HwFacts hw = base_hw();       // 64GiB RAM
+    hw.vram_bytes = GiB(24);
+
+    LlmModel llama8b;
+    llama8b.params = 8030000000ull;
+    llama8b.layers = 32;
+    llama8b.kv_dim = 1024;
+    llama8b.max_context = 8192;
+
+    LlmPlan small = plan_llm(hw, llama8b);
+    REQUIRE(small.fits);
+    REQUIRE(small.gpu_layers == 32);
+    REQUIRE(small.context_length == 8192);
+    REQUIRE(small.kv_cache_bytes == 2ull * 32 * 1024 * 2 * 8192);
+
+    LlmModel llama70b = llama8b;
+    llama70b.params = 70600000000ull;
+    llama70b.layers = 80;
+    LlmPlan large = plan_llm(hw, llama70b);
+    REQUIRE(large.fits);
+    REQUIRE(large.gpu_layers > 0);
+    REQUIRE(large.gpu_layers < 80);
+    REQUIRE(large.gpu_bytes_used <= llm_memory_budget(hw).gpu_bytes);
+
+    LlmModel llama70b_f16 = llama70b;
+    llama70b_f16.quant = LlmQuant::F16;
+    REQUIRE_FALSE(plan_llm(hw, llama70b_f16).fits);
+
+    // Bigger quants fit fewer parameters.
+    auto fits = llm_capacity(hw);
+    REQUIRE(fits[0].quant == LlmQuant::Q4_K_M);
+    REQUIRE(fits[0].max_params_gpu > fits[3].max_params_gpu);
+    REQUIRE(fits[0].max_params_total > fits[0].max_params_gpu);
+
+    LlmBudgetOptions measured;
+    measured.gpu_bandwidth_bytes_per_sec = 900e9;
+    REQUIRE(plan_llm(hw, llama8b, measured).decode_tokens_per_sec > 100.0);
+    REQUIRE(plan_llm(hw, llama70b, measured).decode_tokens_per_sec == 0.0);  // host part unmeasured
+
+    HwFacts laptop = base_hw();
+    laptop.ram_bytes = GiB(8);
+    laptop.gpu_kind = GpuKind::Integrated;
+    laptop.has_discrete_gpu = false;
+    laptop.vram_bytes = 0;
+    REQUIRE(llm_memory_budget(laptop).gpu_bytes == 0);
+    REQUIRE_FALSE(plan_llm(laptop, llama8b).fits);
+}
+
+TEST_CASE("Thread pools follow core types, NUMA nodes and quotas") {
+    auto group = [](int node, CoreType type, int cores, int first_cpu, int cpus) {
+        CpuGroup g;
+        g.numa_node = node;
+        g.core_type = type;
+        g.cores = cores;
+        for (int c = first_cpu; c < first_cpu + cpus; c++) g.cpus.push_back(c);
+        return g;
+    };
+
+    // Hybrid desktop: 8 P-cores with SMT, 16 E-cores.
+    CpuTopology hybrid;
+    hybrid.groups = {group(0, CoreType::Efficiency, 16, 16, 16), group(0, CoreType::Performance, 8, 0, 16)};
+    hybrid.allowed_threads = 32;
+    ThreadPoolPlan plan = recommend_thread_pools(hybrid, base_hw());
+    REQUIRE(plan.total.compute == 8);
+    REQUIRE(plan.total.io == 64);
+    REQUIRE(plan.groups.front().core_type == CoreType::Performance);
+    REQUIRE(plan.groups.front().sizes.background == 0);
+    REQUIRE(plan.groups.back().sizes.background == 8);
+
+    // Two NUMA nodes in a container limited to 6 CPUs.
+    CpuTopology server;
+    server.groups = {group(0, CoreType::Unknown, 16, 0, 32), group(1, CoreType::Unknown, 16, 32, 32)};
+    server.allowed_threads = 64;
+    server.cpu_quota = 6.5;
+    plan = recommend_thread_pools(server, base_hw());
+    REQUIRE(plan.total.compute == 6);
+    REQUIRE(plan.groups[0].sizes.compute == 6);
+    REQUIRE(plan.groups[1].sizes.compute == 0);
+    REQUIRE(plan.total.io == 26);
+    REQUIRE(plan.total.background == 1);
+
+    // No topology: fall back to the hardware facts.
+    plan = recommend_thread_pools(CpuTopology{}, base_hw());
+    REQUIRE(plan.total.compute == 8);
+    REQUIRE(plan.total.io == 32);
+}
+
+TEST_CASE("Hardware watcher re-runs only the requested probes") {
+    HwFacts machine = base_hw();
+    machine.ram_bytes = GiB(16);
+    uint8_t ran = 0;
+    auto source = [&](HwFacts& hw, uint8_t probes) {
+        ran |= probes;
+        if (probes & static_cast<uint8_t>(HwProbe::Memory)) hw.ram_bytes = machine.ram_bytes;
+        if (probes & static_cast<uint8_t>(HwProbe::Cpu)) {
+            hw.physical_cores = machine.physical_cores;
+            hw.logical_threads = machine.logical_threads;
+        }
+        if (probes & static_cast<uint8_t>(HwProbe::Gpu)) {
+            hw.gpu_kind = machine.gpu_kind;
+            hw.has_discrete_gpu = machine.has_discrete_gpu;
+            hw.vram_bytes = machine.vram_bytes;
+        }
+    };
+
+    HwWatcher watcher(kDefaultCastePolicy, source);
+    REQUIRE(ran == kAllHwProbes);
+    const Caste initial = watcher.result().caste;
+    REQUIRE(initial == classify_caste(machine).caste);
+
+    std::vector<HwChange> changes;
+    watcher.on_change([&](const HwChange& c) { changes.push_back(c); });
+
+    // eGPU attached with more RAM and cores: a GPU-only refresh still sees the
+    // old RAM and CPU, which cap the caste.
+    machine.gpu_kind = GpuKind::Discrete;
+    machine.has_discrete_gpu = true;
+    machine.vram_bytes = caste_detail::GiB(48);
+    machine.ram_bytes = caste_detail::GiB(128);
+    machine.physical_cores = 32;
+    machine.logical_threads = 64;
+    ran = 0;
+    REQUIRE_FALSE(watcher.refresh(static_cast<uint8_t>(HwProbe::Gpu)));
+    REQUIRE(ran == static_cast<uint8_t>(HwProbe::Gpu));
+    REQUIRE(changes.empty());
+
+    REQUIRE(watcher.refresh(static_cast<uint8_t>(HwProbe::Memory) | static_cast<uint8_t>(HwProbe::Cpu)));
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes[0].previous == initial);
+    REQUIRE(changes[0].result.caste == Caste::Rig);
+    REQUIRE(changes[0].facts.vram_bytes == caste_detail::GiB(48));
+    REQUIRE(watcher.result().caste == Caste::Rig);
+
+    // Balloon driver takes memory back.
+    machine.ram_bytes = caste_detail::GiB(4);
+    REQUIRE(watcher.refresh(static_cast<uint8_t>(HwProbe::Memory)));
+    REQUIRE(changes.size() == 2);
+    REQUIRE(changes[1].result.caste == Caste::Mini);
+
+    HwFacts live = detect_hw_facts();
+    HwFacts partial = live;
+    refresh_hw_facts(partial, static_cast<uint8_t>(HwProbe::Memory));
+    REQUIRE(partial.ram_bytes > 0);
+    REQUIRE(partial.logical_threads == live.logical_threads);
+}
+
+TEST_CASE("casted records round-trip hardware facts") {
+    HwFacts hw = base_hw();
+    hw.vram_bytes = GiB(24);
+    hw.is_virtual_machine = true;
+    hw.cpu_steal_percent = 12;
+
+    uint8_t record[kCastedRecordSize];
+    encode_casted_record(hw, 7, record);
+    HwFacts back;
+    uint32_t generation = 0;
+    REQUIRE(decode_casted_record(record, sizeof(record), back, &generation));
+    REQUIRE(generation == 7);
+    REQUIRE(back.ram_bytes == hw.ram_bytes);
+    REQUIRE(back.vram_bytes == hw.vram_bytes);
+    REQUIRE(back.physical_cores == hw.physical_cores);
+    REQUIRE(back.logical_threads == hw.logical_threads);
+    REQUIRE(back.gpu_kind == GpuKind::Discrete);
+    REQUIRE(back.has_discrete_gpu);
+    REQUIRE(back.is_virtual_machine);
+    REQUIRE(back.cpu_steal_percent == 12);
+
+    HwFacts mac{};
+    mac.ram_bytes = GiB(32);
+    mac.gpu_kind = GpuKind::Unified;
+    mac.is_apple_silicon = true;
+    encode_casted_record(mac, 1, record);
+    REQUIRE(decode_casted_record(record, sizeof(record), back));
+    REQUIRE(back.is_apple_silicon);
+    REQUIRE(classify_caste(back).caste == classify_caste(mac).caste);
+
+    REQUIRE_FALSE(decode_casted_record(record, kCastedRecordSize - 1, back));
+    record[3] = kCastedVersion + 1;
+    REQUIRE_FALSE(decode_casted_record(record, sizeof(record), back));
+
+    // No daemon: the query fails and the cached path detects in-process.
+    REQUIRE_FALSE(query_casted(back, "/nonexistent/casted.sock"));
+    REQUIRE(cached_hw_facts().ram_bytes > 0);
+}
+
+#if !defined(_WIN32)
+TEST_CASE("Shared-memory snapshots are consistent under concurrent publishes") {
+    const std::string name = "/caste-test-" + std::to_string(::getpid());
+    CasteShmPublisher publisher(name.c_str());
+    REQUIRE(publisher.ok());
+
+    REQUIRE_FALSE(CasteShmPublisher(name.c_str()).ok()); // one writer per segment
+
+    CasteShmReader reader(name.c_str());
+    REQUIRE(reader.ok());
+    CasteSnapshot snap;
+    REQUIRE_FALSE(reader.read(snap)); // nothing published yet
+
+    HwFacts hw = base_hw();
+    publisher.publish(hw, classify_caste(hw));
+    REQUIRE(reader.read(snap));
+    REQUIRE(snap.version == 1);
+    REQUIRE(snap.facts.ram_bytes == hw.ram_bytes);
+    REQUIRE(snap.result.caste == classify_caste(hw).caste);
+
+    // Every snapshot must pair facts with the result computed from them.
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        HwFacts w = base_hw();
+        for (uint64_t i = 0; i < 20000; i++) {
+            w.ram_bytes = GiB(4) + i * 4096;
+            w.vram_bytes = i * 2;
+            publisher.publish(w, classify_caste(w));
+        }
+        done = true;
+    });
+    uint32_t last = 0;
+    bool consistent = true;
+    while (!done) {
+        if (!reader.read(snap)) continue;
+        consistent = consistent && snap.result.ram_bytes == snap.facts.ram_bytes &&
+                     snap.result.vram_bytes == snap.facts.vram_bytes && snap.version >= last;
+        last = snap.version;
+    }
+    writer.join();
+    REQUIRE(consistent);
+    REQUIRE(reader.read(snap));
+    REQUIRE(snap.version == 20001);
+
+    REQUIRE_FALSE(CasteShmReader("/caste-test-missing").ok());
+
+    // A publisher that shuts down retires its segment for mapped readers.
+    const std::string retired = name + "-retired";
+    std::optional<CasteShmPublisher> leaving(std::in_place, retired.c_str());
+    REQUIRE(leaving->ok());
+    leaving->publish(hw, classify_caste(hw));
+    CasteShmReader stale_reader(retired.c_str());
+    REQUIRE(stale_reader.read(snap));
+    leaving.reset();
+    REQUIRE_FALSE(stale_reader.read(snap));
+    REQUIRE_FALSE(CasteShmReader(retired.c_str()).ok());
+
+    // A truncated segment is absent rather than a SIGBUS.
+    const std::string small = name + "-small";
+    const int fd = ::shm_open(small.c_str(), O_CREAT | O_RDWR, 0600);
+    REQUIRE(fd >= 0);
+    REQUIRE(::ftruncate(fd, 16) == 0);
+    ::close(fd);
+    REQUIRE_FALSE(CasteShmReader(small.c_str()).ok());
+    ::shm_unlink(small.c_str());
+
+    // A publisher that died without unlinking is replaced.
+    const std::string stale = name + "-stale";
+    const pid_t child = ::fork();
+    if (child == 0) {
+        CasteShmPublisher crashed(stale.c_str());
+        ::_exit(crashed.ok() ? 0 : 1);
+    }
+    int status = 0;
+    REQUIRE(::waitpid(child, &status, 0) == child);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    REQUIRE(CasteShmPublisher(stale.c_str()).ok());
+}
+#endif
+
+TEST_CASE("Build jobs are limited by CPUs and per-job memory") {
+    CpuTopology topo;
+    topo.allowed_threads = 32;
+    MemoryFacts mem;
+    mem.total_bytes = GiB(16);
+    mem.available_bytes = GiB(14);
+
+    // 14GiB free minus a 1.6GiB reserve leaves 12.4GiB: 5 compiles at 1.5GiB
+    // beside one 4GiB link, and the 4.9GiB they leave holds one link.
+    BuildJobs jobs = recommend_build_jobs(topo, mem);
+    REQUIRE(jobs.compile == 5);
+    REQUIRE(jobs.link == 1);
+
+    BuildJobOptions lld;
+    lld.compile_job_bytes = GiB(1);
+    lld.link_job_bytes = GiB(1);
+    jobs = recommend_build_jobs(topo, mem, lld);
+    REQUIRE(jobs.compile == 11);
+    REQUIRE(jobs.link == 1);
+    REQUIRE(jobs.compile * lld.compile_job_bytes + jobs.link * lld.link_job_bytes <= GiB(12) + GiB(1) / 2);
+
+    mem.total_bytes = GiB(64);
+    mem.available_bytes = GiB(64);
+    lld.link_job_bytes = GiB(1) / 2;
+    jobs = recommend_build_jobs(topo, mem, lld);
+    REQUIRE(jobs.compile == 32);
+    REQUIRE(jobs.link == 32); // never above compile jobs
+
+    topo.cpu_quota = 3.5;
+    REQUIRE(recommend_build_jobs(topo, mem).compile == 4);
+
+    mem.available_bytes = GiB(1);
+    jobs = recommend_build_jobs(topo, mem);
+    REQUIRE(jobs.compile == 1);
+    REQUIRE(jobs.link == 1);
+
+    uint64_t bytes = 0;
+    REQUIRE(parse_size_bytes("1.5GiB", bytes));
+    REQUIRE(bytes == GiB(1) + 512ull * 1024 * 1024);
+    REQUIRE_FALSE(parse_size_bytes("lots", bytes));
+    REQUIRE_FALSE(parse_size_bytes("inf", bytes));
+    REQUIRE_FALSE(parse_size_bytes("nan", bytes));
+    REQUIRE_FALSE(parse_size_bytes("1e30", bytes));
+    REQUIRE_FALSE(parse_size_bytes("16777216TiB", bytes)); // exactly 2^64
+}
+
+TEST_CASE("Exports quote values for each shell") {
+    ExportFormat format;
+    REQUIRE(parse_export_format("fish", format));
+    REQUIRE(format == ExportFormat::Fish);
+    REQUIRE_FALSE(parse_export_format("", format));
+    REQUIRE_FALSE(parse_export_format("bash", format));
+
+    const std::vector<ExportVariable> vars = {{"CASTE", "Rig"}, {"ODD", "it's a\\b \"c\""}};
+    REQUIRE(format_exports(vars, ExportFormat::Sh) == "export CASTE='Rig'\nexport ODD='it'\\''s a\\b \"c\"'\n");
+    REQUIRE(format_exports(vars, ExportFormat::Fish) == "set -gx CASTE 'Rig'\nset -gx ODD 'it\\'s a\\\\b \"c\"'\n");
+    REQUIRE(format_exports(vars, ExportFormat::PowerShell) == "$env:CASTE = 'Rig'\n$env:ODD = 'it''s a\\b \"c\"'\n");
+    REQUIRE(format_exports(vars, ExportFormat::Dotenv) == "CASTE=Rig\nODD=\"it's a\\\\b \\\"c\\\"\"\n");
+    REQUIRE(format_exports({{"CASTE_ISA_LEVEL", "x86-64-v3"}}, ExportFormat::Dotenv) == "CASTE_ISA_LEVEL=x86-64-v3\n");
+    REQUIRE(format_exports({{"CASTE_ISA_LEVEL", ""}}, ExportFormat::Dotenv) == "CASTE_ISA_LEVEL=\n");
+
+    HwFacts hw = base_hw();
+    ThreadPoolSizes pools;
+    pools.compute = 12;
+    const std::vector<ExportVariable> env = export_variables(hw, classify_caste(hw), pools, BuildJobs{6, 2});
+    REQUIRE(env.size() == 10);
+    REQUIRE(std::string(env[0].name) == "CASTE");
+    REQUIRE(env[0].value == caste_name(classify_caste(hw).caste));
+    REQUIRE(std::string(env[6].name) == "CASTE_COMPILE_JOBS");
+    REQUIRE(env[6].value == "6");
+    REQUIRE(std::string(env[8].name) == "OMP_NUM_THREADS");
+    REQUIRE(env[8].value == "12");
+}
+
+TEST_CASE("ISA level is a -march value for this architecture") {
+    const std::string isa = detect_isa_level();
+#if defined(__x86_64__) || defined(_M_X64)
+    REQUIRE((isa == "x86-64" || isa == "x86-64-v2" || isa == "x86-64-v3" || isa == "x86-64-v4"));
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    REQUIRE(isa == "armv8-a");
+#else
+    REQUIRE(isa.empty());
+#endif
+}
+
+TEST_CASE("Memory budgets respect cgroup limits, tenants and caste") {
+    using caste_detail::GiB;
+    using caste_detail::MiB;
+
+    MemoryFacts mem;
+    mem.total_bytes = GiB(32);
+    mem.available_bytes = GiB(20);
+
+    // Reserve is 10% of 32GiB; Developer claims half of the rest.
+    MemoryBudget b = recommend_memory_budget(mem, Caste::Developer);
+    REQUIRE(b.limit_bytes == GiB(32));
+    REQUIRE(b.free_bytes == GiB(20));
+    const uint64_t claim = static_cast<uint64_t>(static_cast<double>(GiB(20) - GiB(32) / 10) * 0.5);
+    REQUIRE(b.claimable_bytes + 1 >= claim);
+    REQUIRE(b.claimable_bytes <= claim + 1);
+    REQUIRE(b.hot_cache_bytes > b.warm_cache_bytes);
+    REQUIRE(b.warm_cache_bytes > b.scratch_bytes);
+    REQUIRE(b.hot_cache_bytes + b.warm_cache_bytes + b.scratch_bytes <= b.claimable_bytes);
+    REQUIRE(b.hot_cache_bytes + b.warm_cache_bytes + b.scratch_bytes + 3 >= b.claimable_bytes);
+
+    // Smaller castes leave more for other applications.
+    REQUIRE(recommend_memory_budget(mem, Caste::Mini).claimable_bytes < b.claimable_bytes);
+    REQUIRE(recommend_memory_budget(mem, Caste::Rig).claimable_bytes > b.claimable_bytes);
+
+    // A 4GiB container with 1GiB charged: 3GiB free, 1GiB reserve.
+    mem.cgroup_limit_bytes = GiB(4);
+    mem.cgroup_usage_bytes = GiB(1);
+    b = recommend_memory_budget(mem, Caste::Developer);
+    REQUIRE(b.limit_bytes == GiB(4));
+    REQUIRE(b.free_bytes == GiB(3));
+    REQUIRE(b.claimable_bytes == GiB(1));
+
+    MemoryHeadroomPolicy shared;
+    shared.tenants = 2;
+    REQUIRE(recommend_memory_budget(mem, Caste::Developer, shared).claimable_bytes == MiB(512));
+
+    // Over the limit: nothing to claim.
+    mem.cgroup_usage_bytes = GiB(5);
+    b = recommend_memory_budget(mem, Caste::Rig);
+    REQUIRE(b.free_bytes == 0);
+    REQUIRE(b.claimable_bytes == 0);
+    REQUIRE(b.hot_cache_bytes == 0);
+
+    MemoryFacts live = detect_memory_facts();
+    REQUIRE(live.total_bytes > 0);
+    REQUIRE(live.available_bytes <= live.total_bytes);
+}
+
+TEST_CASE("Reason codes render the familiar text") {
+    HwFacts hw = base_hw();
+    hw.vram_bytes = GiB(24);
+    REQUIRE(caste_reason_text(classify_caste(hw)) == "discrete GPU VRAM caste");
+
+    hw.ram_bytes = GiB(16);
+    REQUIRE(caste_reason_text(classify_caste(hw)) == "discrete GPU VRAM caste; RAM cap applied");
+
+    hw.ram_bytes = GiB(4);
+    REQUIRE(caste_reason_text(classify_caste(hw)) == "RAM < ~7.5GB");
+
+    HwFacts arc{};
+    arc.ram_bytes = GiB(16);
+    arc.physical_cores = 8;
+    arc.logical_threads = 16;
+    arc.gpu_kind = GpuKind::Integrated;
+    arc.is_intel_arc = true;
+    REQUIRE(caste_reason_text(classify_caste(arc)) ==
+            "integrated GPU caste; Arc-class iGPU with >=16GB RAM => Developer floor; RAM cap applied");
+}
+
+TEST_CASE("Reason codes expose rules and inputs for machine consumers") {
+    HwFacts hw = base_hw();
+    hw.ram_bytes = GiB(16);
+    hw.vram_bytes = GiB(24);
+    hw.physical_cores = 4;
+
+    CasteResult r = classify_caste(hw);
+    REQUIRE(r.reasons.has(CasteRule::BaseDiscreteVram));
+    REQUIRE(r.reasons.has(CasteRule::RamCap));
+    REQUIRE(r.reasons.has(CasteRule::CpuCap));
+    REQUIRE_FALSE(r.reasons.has(CasteRule::RamFloor));
+    REQUIRE(r.base == Caste::Rig);
+    REQUIRE(r.ram_cap == Caste::User);
+    REQUIRE(r.cpu_cap == Caste::User);
+    REQUIRE(r.ram_bytes == GiB(16));
+    REQUIRE(r.effective_cores == 4);
+
+    HwFacts weak_cpu = base_hw();
+    weak_cpu.vram_bytes = GiB(24);
+    weak_cpu.physical_cores = 2;
+    REQUIRE(classify_caste(weak_cpu).reasons.has(CasteRule::UserFloor));
+
+    // Below the RAM floor the intermediate castes are still evaluated.
+    HwFacts small_vm{};
+    small_vm.ram_bytes = GiB(6);
+    small_vm.physical_cores = 1;
+    small_vm.logical_threads = 1;
+    small_vm.is_virtual_machine = true;
+    CasteResult floor = classify_caste(small_vm);
+    REQUIRE(floor.caste == Caste::Mini);
+    REQUIRE(floor.reasons.bits == static_cast<uint32_t>(CasteRule::RamFloor));
+    REQUIRE(floor.base == Caste::User);
+    REQUIRE(floor.ram_cap == Caste::Mini);
+    REQUIRE(floor.cpu_cap == Caste::Mini);
+    REQUIRE(floor.effective_cores == 1);
+
+    for (CasteRule rule : kAllCasteRules) {
+        REQUIRE(caste_rule_name(rule) != nullptr);
+    }
+    REQUIRE(std::string(caste_rule_name(CasteRule::RamCap)) == "ram_cap");
+}
+
+TEST_CASE("Reason formatter works in a fixed buffer") {
+    HwFacts hw = base_hw();
+    hw.ram_bytes = GiB(16);
+    hw.vram_bytes = GiB(24);
+    CasteResult r = classify_caste(hw);
+
+    char buf[64];
+    size_t n = format_caste_reason(r, buf, sizeof(buf));
+    REQUIRE(n == caste_reason_text(r).size());
+    REQUIRE(std::string(buf) == caste_reason_text(r));
+
+    char tiny[8];
+    REQUIRE(format_caste_reason(r, tiny, sizeof(tiny)) == n);
+    REQUIRE(std::string(tiny) == "discret");
+    REQUIRE(format_caste_reason(r, nullptr, 0) == n);
+}
+
+TEST_CASE("Batch classification matches the scalar path bit for bit") {
+    // Values straddling every default threshold, plus zeros.
+    const uint64_t sizes[] = {0, GiB(2) - 1, GiB(2), GiB(6), GiB(8) - GiB(1) / 2 - 1, GiB(8) - GiB(1) / 2,
+                              GiB(12), GiB(16) - 1, GiB(16), GiB(24), GiB(32) - 1, GiB(32), GiB(64), GiB(256)};
+    const int32_t counts[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 12, 16, 32, 64};
+    const uint8_t steals[] = {0, 10, 50, 100, 200};
+
+    const size_t n = 20000;
+    std::vector<uint64_t> ram(n), vram(n);
+    std::vector<int32_t> cores(n), threads(n);
+    std::vector<uint8_t> flags(n), steal(n), out(n);
+
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    auto next = [&](size_t mod) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<size_t>((state >> 33) % mod);
+    };
+    for (size_t i = 0; i < n; i++) {
+        ram[i] = sizes[next(std::size(sizes))];
+        vram[i] = sizes[next(std::size(sizes))];
+        cores[i] = counts[next(std::size(counts))];
+        threads[i] = counts[next(std::size(counts))];
+        flags[i] = static_cast<uint8_t>(next(16));
+        steal[i] = steals[next(std::size(steals))];
+    }
+
+    HwFactsColumns cols;
+    cols.count = n;
+    cols.ram_bytes = ram.data();
+    cols.vram_bytes = vram.data();
+    cols.physical_cores = cores.data();
+    cols.logical_threads = threads.data();
+    cols.flags = flags.data();
+    cols.cpu_steal_percent = steal.data();
+
+    CastePolicy strict = kDefaultCastePolicy;
+    REQUIRE(parse_policy("vram_min = 0 4GiB 12GiB 24GiB 48GiB\ncpu_cores_min = 0 2 8 12 16\n", strict));
+
+    const CastePolicy* policies[] = {&kDefaultCastePolicy, &strict};
+    for (const CastePolicy* policy : policies) {
+        classify_many(cols, out.data(), *policy);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < n; i++) {
+            Caste expected = classify_caste(hw_facts_from_columns(cols, i), *policy).caste;
+            if (out[i] != static_cast<uint8_t>(expected)) mismatches++;
+        }
+        REQUIRE(mismatches == 0);
+    }
+}
+
+TEST_CASE("hw_flags round-trips through the column view") {
+    HwFacts hw = base_hw();
+    hw.vram_bytes = GiB(16);
+    hw.is_virtual_machine = true;
+    hw.cpu_steal_percent = 5;
+
+    uint8_t flags = hw_flags(hw);
+    int32_t cores = hw.physical_cores, threads = hw.logical_threads;
+    uint8_t steal = hw.cpu_steal_percent;
+    HwFactsColumns cols;
+    cols.count = 1;
+    cols.ram_bytes = &hw.ram_bytes;
+    cols.vram_bytes = &hw.vram_bytes;
+    cols.physical_cores = &cores;
+    cols.logical_threads = &threads;
+    cols.flags = &flags;
+    cols.cpu_steal_percent = &steal;
+
+    uint8_t out = 0xff;
+    classify_many(cols, &out);
+    REQUIRE(out == static_cast<uint8_t>(classify_caste(hw).caste));
+}
+
+TEST_CASE("Fleet CSV records follow the header and tolerate CRLF") {
+    FleetRecordParser csv(FleetFormat::Csv);
+    REQUIRE_FALSE(csv.set_header("physical_cores,vram_bytes"));
+    REQUIRE(csv.set_header("host,ram_bytes,\"gpu_kind\",vram_bytes,is_virtual_machine\r"));
+
+    HwFacts hw;
+    REQUIRE(csv.parse("\"a,b\",34359738368,discrete,8589934592,yes\r", hw));
+    REQUIRE(hw.ram_bytes == GiB(32));
+    REQUIRE(hw.gpu_kind == GpuKind::Discrete);
+    REQUIRE(hw.vram_bytes == GiB(8));
+    REQUIRE(hw.is_virtual_machine);
+    REQUIRE(hw.physical_cores == 0); // no column: reads as 0
+
+    REQUIRE(csv.parse("b,1.6e10,,0,", hw)); // empty GPU kind and flag
+    REQUIRE(hw.ram_bytes == 16000000000ull);
+    REQUIRE(hw.gpu_kind == GpuKind::None);
+
+    REQUIRE_FALSE(csv.parse("c,34359738368,discrete,0", hw));    // missing column
+    REQUIRE_FALSE(csv.parse("c,34359738368,discrete,0,no,1", hw)); // extra column
+    REQUIRE_FALSE(csv.parse("c,lots,discrete,0,no", hw));
+    REQUIRE_FALSE(csv.parse("c,-5,discrete,0,no", hw));
+    REQUIRE_FALSE(csv.parse("c,1,quantum,0,no", hw));
+}
+
+TEST_CASE("Fleet NDJSON records need ram_bytes and skip nested values") {
+    FleetRecordParser ndjson(FleetFormat::Ndjson);
+    HwFacts hw;
+    REQUIRE(ndjson.parse(R"({"ram_bytes": 68719476736, "tags": {"rack": [1, 2]}, "gpu_kind": "unified"})", hw));
+    REQUIRE(hw.ram_bytes == GiB(64));
+    REQUIRE(hw.gpu_kind == GpuKind::Unified);
+    REQUIRE(ndjson.parse("{\"ram_bytes\":1,\"cpu_steal_percent\":250}\r", hw));
+    REQUIRE(hw.cpu_steal_percent == 100);
+
+    REQUIRE_FALSE(ndjson.parse(R"({"physical_cores": 8})", hw));
+    REQUIRE_FALSE(ndjson.parse(R"({"ram_bytes": 1)", hw));
+    REQUIRE_FALSE(ndjson.parse(R"({"ram_bytes": 1} trailing)", hw));
+    REQUIRE_FALSE(ndjson.parse(R"({"ram_bytes": oops})", hw));
+    REQUIRE_FALSE(ndjson.parse(R"([1, 2])", hw));
+}
+
+TEST_CASE("Fleet chunks end on line boundaries and count lines") {
+    FleetRecordParser csv(FleetFormat::Csv);
+    REQUIRE(csv.set_header("ram_bytes,vram_bytes,gpu_kind"));
+    const std::string record = "137438953472,25769803776,discrete\r\n"; // Rig
+    const std::string text_small = record + "\r\n" + "bad\r\n" + record;
+    FleetChunk small = classify_fleet_chunk(csv, text_small, kDefaultCastePolicy, true);
+    REQUIRE(small.lines == 4);
+    REQUIRE(small.counts[static_cast<int>(Caste::Rig)] == 2);
+    REQUIRE(small.invalid == 1);
+    REQUIRE(small.first_invalid_line == 3);
+    REQUIRE(small.records == "Rig\ninvalid\nRig\n"); // blank lines have no record
+
+    // Fill up to one chunk so that the next record straddles kFleetChunkBytes.
+    std::string text;
+    text.reserve(kFleetChunkBytes + 4 * record.size());
+    while (text.size() + record.size() <= kFleetChunkBytes) text += record;
+    REQUIRE(text.size() < kFleetChunkBytes);
+    const size_t records_before = text.size() / record.size();
+    text += record + "oops\n" + record;
+
+    const size_t end = fleet_chunk_end(text.data(), text.size(), 0);
+    REQUIRE(end == (records_before + 1) * record.size()); // after the straddling record
+    REQUIRE(fleet_chunk_end(text.data(), text.size(), end) == text.size());
+
+    const FleetChunk first = classify_fleet_chunk(csv, std::string_view(text).substr(0, end));
+    const FleetChunk second = classify_fleet_chunk(csv, std::string_view(text).substr(end));
+    REQUIRE(first.invalid == 0);
+    REQUIRE(first.counts[static_cast<int>(Caste::Rig)] == records_before + 1);
+    REQUIRE(second.counts[static_cast<int>(Caste::Rig)] == 1);
+    REQUIRE(second.invalid == 1);
+    // caste-fleet numbers lines across chunks: header, earlier chunks, then
+    // the position within the chunk.
+    REQUIRE(1 + first.lines + second.first_invalid_line == records_before + 3);
+}
+
+TEST_CASE("Default policy is valid and matches the built-in rules") {
+    REQUIRE(validate_policy(kDefaultCastePolicy));
+
+    HwFacts hw = base_hw();
+    hw.vram_bytes = GiB(16);
+    REQUIRE(classify_caste(hw, kDefaultCastePolicy).caste == classify_caste(hw).caste);
+}
+
+TEST_CASE("Policies loaded from text override thresholds") {
+    CastePolicy policy{};
+    std::string error;
+    REQUIRE(parse_policy("# stricter VRAM tiers\n"
+                         "vram_min = 0 4GiB 12GiB 24GiB 48GiB\n"
+                         "ram_floor = 7.5GiB\n",
+                         policy, &error));
+    REQUIRE(policy.vram_min[2] == GiB(12));
+    REQUIRE(policy.ram_cap_min == kDefaultCastePolicy.ram_cap_min);
+
+    HwFacts hw = base_hw();
+    hw.vram_bytes = GiB(24);
+    REQUIRE(classify_caste(hw).caste == Caste::Rig);
+    REQUIRE(classify_caste(hw, policy).caste == Caste::Workstation);
+}
+
+TEST_CASE("Policy loading rejects non-monotonic and malformed tables") {
+    CastePolicy policy = kDefaultCastePolicy;
+    std::string error;
+
+    REQUIRE_FALSE(parse_policy("vram_min = 0 8GiB 6GiB 16GiB 24GiB\n", policy, &error));
+    REQUIRE(error.find("vram_min") != std::string::npos);
+
+    REQUIRE_FALSE(parse_policy("vram_min = 0 2GiB 6GiB\n", policy, &error));
+    REQUIRE_FALSE(parse_policy("vram_min = 0 2XB 6GiB 16GiB 24GiB\n", policy, &error));
+    REQUIRE_FALSE(parse_policy("no_such_key = 1\n", policy, &error));
+    REQUIRE(error.find("line 1") != std::string::npos);
+
+    // Failed loads leave the output untouched.
+    REQUIRE(policy.vram_min == kDefaultCastePolicy.vram_min);
+}
+
+TEST_CASE("Virtual machines count vCPUs as hyperthreads") {
+    HwFacts hw = base_hw();
+    hw.vram_bytes = GiB(24);
+    hw.physical_cores = 8;   // guest without SMT topology: 8 "cores", 8 threads
+    hw.logical_threads = 8;
+    REQUIRE(classify_caste(hw).caste == Caste::Rig);
+
+    hw.is_virtual_machine = true; // 8 vCPUs ~ 4 host cores => User cap
+    CasteResult vm = classify_caste(hw);
+    REQUIRE(vm.caste == Caste::User);
+    REQUIRE(caste_reason_text(vm).find("8 vCPUs counted as 4 cores") != std::string::npos);
+
+    hw.physical_cores = 32;  // 32 vCPUs ~ 16 cores: no cap
+    hw.logical_threads = 32;
+    REQUIRE(classify_caste(hw).caste == Caste::Rig);
+
+    hw.cpu_steal_percent = 70; // noisy neighbour leaves ~4 cores
+    REQUIRE(classify_caste(hw).caste == Caste::User);
+
+    // Guest that exposes SMT siblings keeps its reported core count.
+    hw.cpu_steal_percent = 0;
+    hw.physical_cores = 6;
+    hw.logical_threads = 12;
+    REQUIRE(classify_caste(hw).caste == Caste::Rig);
+}
+
+TEST_CASE("Power-aware classification demotes on battery") {
+    HwFacts hw = base_hw();
+    hw.vram_bytes = GiB(16); // Workstation on AC
+
+    PowerState ac{};
+    REQUIRE(classify_caste_power_aware(hw, ac).caste == Caste::Workstation);
+
+    PowerState battery{};
+    battery.has_battery = true;
+    battery.on_ac = false;
+    battery.battery_percent = 80;
+    REQUIRE(classify_caste_power_aware(hw, battery).caste == Caste::Developer);
+
+    battery.battery_percent = 10;
+    REQUIRE(classify_caste_power_aware(hw, battery).caste == Caste::User);
+
+    battery.profile = PowerProfile::LowPower;
+    REQUIRE(classify_caste_power_aware(hw, battery).caste == Caste::Mini);
+    battery.battery_percent = 5;
+    REQUIRE(classify_caste_power_aware(hw, battery).caste == Caste::Mini);
+}
+
+TEST_CASE("PowerMonitor notifies only on change") {
+    PowerState current{};
+    PowerMonitor monitor([&] { return current; });
+
+    int calls = 0;
+    PowerState seen{};
+    monitor.on_change([&](const PowerState& ps) { calls++; seen = ps; });
+
+    REQUIRE_FALSE(monitor.poll());
+    REQUIRE(calls == 0);
+
+    current.has_battery = true;
+    current.on_ac = false;
+    REQUIRE(monitor.poll());
+    REQUIRE(calls == 1);
+    REQUIRE_FALSE(seen.on_ac);
+
+    REQUIRE_FALSE(monitor.poll());
+    REQUIRE(calls == 1);
+}
+
+TEST_CASE("Sustained performance reflects throttling and power limits") {
+    ThermalState t{};
+    REQUIRE(sustained_performance(t) == SustainedPerf::Unknown);
+
+    t.zone_count = 2;
+    t.max_temp_c = 45.0;
+    t.min_trip_margin_c = 50.0;
+    t.rapl_long_term_watts = 125.0;
+    t.has_fan = true;
+    REQUIRE(sustained_performance(t) == SustainedPerf::Full);
+
+    t.rapl_long_term_watts = 28.0;
+    REQUIRE(sustained_performance(t) == SustainedPerf::Reduced);
+
+    t.rapl_long_term_watts = 15.0; // U-class laptop
+    REQUIRE(sustained_performance(t) == SustainedPerf::Reduced);
+    t.has_fan = false; // fanless mini PC
+    REQUIRE(sustained_performance(t) == SustainedPerf::Limited);
+
+    t.rapl_long_term_watts = 7.0; // tablet, with or without a fan
+    t.has_fan = true;
+    REQUIRE(sustained_performance(t) == SustainedPerf::Limited);
+
+    ThermalState hot{};
+    hot.zone_count = 1;
+    hot.core_throttle_count = 12;
+    hot.min_trip_margin_c = 20.0;
+    REQUIRE(sustained_performance(hot) == SustainedPerf::Reduced);
+    hot.min_trip_margin_c = 2.0;
+    REQUIRE(sustained_performance(hot) == SustainedPerf::Limited);
+
+    // A dozen events in a day of uptime is not ongoing throttling.
+    hot.throttle_window_s = 86400.0;
+    REQUIRE(sustained_performance(hot) == SustainedPerf::Reduced); // trip margin only
+    hot.min_trip_margin_c = 20.0;
+    REQUIRE(sustained_performance(hot) == SustainedPerf::Full);
+    hot.min_trip_margin_c = 2.0;
+    hot.throttle_window_s = 600.0;
+    REQUIRE(sustained_performance(hot) == SustainedPerf::Limited);
+}
+
+TEST_CASE("Sustained classification demotes throttling machines") {
+    HwFacts hw = base_hw();
+    hw.vram_bytes = GiB(24); // Rig
+
+    ThermalState cool{};
+    cool.zone_count = 1;
+    cool.min_trip_margin_c = 40.0;
+    REQUIRE(classify_caste_sustained(hw, cool).caste == Caste::Rig);
+
+    ThermalState fanless{};
+    fanless.rapl_long_term_watts = 6.0;
+    REQUIRE(classify_caste_sustained(hw, fanless).caste == Caste::Developer);
+}
+
+TEST_CASE("Live load demotes a saturated host") {
+    HwFacts hw = base_hw(); // 16 threads
+
+    LoadSample idle{};
+    idle.psi_available = true;
+    idle.loadavg_1min = 1.0f;
+    LiveCaste live = live_caste(Caste::Rig, hw, idle);
+    REQUIRE(live.caste == Caste::Rig);
+    REQUIRE(live.cpu_headroom > 0.9f);
+    REQUIRE(live.memory_headroom == 1.0f);
+
+    LoadSample busy = idle;
+    busy.loadavg_1min = 12.0f; // 25% of threads free
+    busy.cpu_some = 30.0f;
+    REQUIRE(live_caste(Caste::Rig, hw, busy).caste == Caste::Workstation);
+
+    LoadSample thrashing = idle;
+    thrashing.memory_some = 20.0f;
+    thrashing.memory_full = 20.0f; // weighted x4 => 80% stalled
+    LiveCaste t = live_caste(Caste::Developer, hw, thrashing);
+    REQUIRE(t.caste == Caste::Mini);
+    REQUIRE(t.memory_headroom < 0.25f);
+
+    LoadSample unknown{};
+    REQUIRE(live_caste(Caste::User, hw, unknown).caste == Caste::User);
+}
+
 TEST_CASE("Caste names are stable") {
     REQUIRE(std::string(caste_name(Caste::Mini)) == "Mini");
     REQUIRE(std::string(caste_name(Caste::User)) == "User");